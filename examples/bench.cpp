@@ -0,0 +1,120 @@
+//
+//  Portable File Dialogs
+//
+//  Copyright © 2018—2019 Sam Hocevar <sam@hocevar.net>
+//
+//  This program is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+//
+//  Measure how long building a helper command takes without a spec
+//  (“old”), with a new spec every time (“cold”), and with a spec that is
+//  reused (“warm”). Spawning the helper is left out, since it costs a lot
+//  more and is the same in all three cases. Pass zenity or kdialog to
+//  choose the helper whose commands are built.
+//
+
+#include "portable-file-dialogs.h"
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#define COMMAND_COUNT 100000
+
+// Dialogs that only build commands; the one dialog each of them starts
+// runs true(1) instead of a helper, and is gone at once
+class file_bench : public pfd::open_file
+{
+public:
+    file_bench() : pfd::open_file("", "", {}) { result(); }
+
+    std::vector<std::string> command(std::string const &title,
+                                     std::string const &path,
+                                     std::vector<std::string> const &filters,
+                                     pfd::file_dialog_spec const *spec) const
+    {
+        return helper_command(type::open, title, path, filters, pfd::opt::none, spec);
+    }
+};
+
+class message_bench : public pfd::message
+{
+public:
+    message_bench() : pfd::message("", "") { result(); }
+
+    std::vector<std::string> command(std::string const &title,
+                                     std::string const &text,
+                                     pfd::message_spec const *spec) const
+    {
+        pfd::internal::int_map<pfd::button> mappings;
+        return helper_command(title, text, pfd::choice::yes_no, pfd::icon::info, spec, mappings);
+    }
+};
+
+// The average time one command takes, in microseconds
+static double measure(std::function<void(std::string const &)> const &f)
+{
+    std::vector<std::string> paths;
+    for (int i = 0; i < 16; ++i)
+        paths.push_back("/home/user/assets/texture" + std::to_string(i) + ".png");
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < COMMAND_COUNT; ++i)
+        f(paths[i % paths.size()]);
+    std::chrono::duration<double, std::micro> d = std::chrono::steady_clock::now() - start;
+    return d.count() / COMMAND_COUNT;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string name = argc > 1 ? argv[1] : "zenity";
+    auto helper = name == "kdialog" ? pfd::backend::kdialog : pfd::backend::zenity;
+    pfd::settings::backend(helper, "/bin/true");
+
+    std::string const title = "Import asset";
+    std::vector<std::string> const filters = { "Images", "*.png *.jpg *.jpeg", "All Files", "*" };
+
+    file_bench file;
+    double file_old = measure([&](std::string const &path)
+    {
+        file.command(title, path, filters, nullptr);
+    });
+    double file_cold = measure([&](std::string const &path)
+    {
+        pfd::file_dialog_spec spec(title, filters);
+        file.command(title, path, filters, &spec);
+    });
+    pfd::file_dialog_spec file_spec(title, filters);
+    double file_warm = measure([&](std::string const &path)
+    {
+        file.command(title, path, filters, &file_spec);
+    });
+
+    message_bench message;
+    double message_old = measure([&](std::string const &path)
+    {
+        message.command(title, path, nullptr);
+    });
+    double message_cold = measure([&](std::string const &path)
+    {
+        pfd::message_spec spec(title, pfd::choice::yes_no);
+        message.command(title, path, &spec);
+    });
+    pfd::message_spec message_spec(title, pfd::choice::yes_no);
+    double message_warm = measure([&](std::string const &path)
+    {
+        message.command(title, path, &message_spec);
+    });
+
+    printf("µs per %-10s     old     cold     warm\n", name.c_str());
+    printf("open_file        %8.2f %8.2f %8.2f\n", file_old, file_cold, file_warm);
+    printf("message          %8.2f %8.2f %8.2f\n", message_old, message_cold, message_warm);
+    return 0;
+}
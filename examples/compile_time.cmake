@@ -0,0 +1,109 @@
+#
+#  Portable File Dialogs
+#
+#  Copyright © 2018—2019 Sam Hocevar <sam@hocevar.net>
+#
+#  This program is free software. It comes without any warranty, to
+#  the extent permitted by applicable law. You can redistribute it
+#  and/or modify it under the terms of the Do What the Fuck You Want
+#  to Public License, Version 2, as published by the WTFPL Task Force.
+#  See http://www.wtfpl.net/ for more details.
+#
+
+#
+#  Measure how long a project with ten files using dialogs takes to build
+#  from scratch, and to rebuild after one file changed, with each way of
+#  linking to pfd: the header-only target, the static library, and the
+#  static library with PFD_PRECOMPILE_HEADER. Run it from any directory:
+#
+#    cmake -P examples/compile_time.cmake
+#
+#  It builds in pfd-compile-time/ below the current directory; set
+#  PFD_FILE_COUNT to change the number of files.
+#
+
+cmake_minimum_required(VERSION 3.23)
+
+get_filename_component(PFD_SOURCE_DIR "${CMAKE_CURRENT_LIST_DIR}/.." ABSOLUTE)
+set(WORK_DIR "${CMAKE_CURRENT_BINARY_DIR}/pfd-compile-time")
+if(NOT DEFINED PFD_FILE_COUNT)
+    set(PFD_FILE_COUNT 10)
+endif()
+
+# A project whose files each show a dialog
+file(REMOVE_RECURSE "${WORK_DIR}")
+set(PROJECT_DIR "${WORK_DIR}/project")
+set(SOURCES main.cpp)
+set(DECLARATIONS "")
+set(CALLS "")
+foreach(i RANGE 1 ${PFD_FILE_COUNT})
+    file(WRITE "${PROJECT_DIR}/file${i}.cpp"
+         "#include \"portable-file-dialogs.h\"\n"
+         "bool ask${i}() { return pfd::message(\"File ${i}\", \"Continue?\").result() == pfd::button::ok; }\n")
+    list(APPEND SOURCES file${i}.cpp)
+    string(APPEND DECLARATIONS "bool ask${i}();\n")
+    string(APPEND CALLS "    ask${i}();\n")
+endforeach()
+file(WRITE "${PROJECT_DIR}/main.cpp" "${DECLARATIONS}int main()\n{\n${CALLS}}\n")
+list(JOIN SOURCES " " SOURCES)
+file(WRITE "${PROJECT_DIR}/CMakeLists.txt"
+     "cmake_minimum_required(VERSION 3.16)\n"
+     "project(pfd_compile_time CXX)\n"
+     "add_subdirectory(\"${PFD_SOURCE_DIR}\" pfd)\n"
+     "add_executable(consumer ${SOURCES})\n"
+     "target_link_libraries(consumer PRIVATE \${PFD_TARGET})\n")
+
+# Run a build step and store how long it took, in seconds
+function(timed_build var dir)
+    string(TIMESTAMP start "%s%f")
+    execute_process(COMMAND "${CMAKE_COMMAND}" --build "${dir}" -j 1
+                    RESULT_VARIABLE result OUTPUT_QUIET)
+    string(TIMESTAMP end "%s%f")
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "Building ${dir} failed")
+    endif()
+    math(EXPR ms "(${end} - ${start}) / 1000")
+    math(EXPR whole "${ms} / 1000")
+    math(EXPR tenths "${ms} % 1000 / 100")
+    set(${var} "${whole}.${tenths}" PARENT_SCOPE)
+endfunction()
+
+message("seconds for ${PFD_FILE_COUNT} files             clean   one file")
+foreach(variant header static static_pch)
+    if(variant STREQUAL "header")
+        set(target portable_file_dialogs)
+    else()
+        set(target portable_file_dialogs_static)
+    endif()
+    if(variant STREQUAL "static_pch")
+        set(pch ON)
+    else()
+        set(pch OFF)
+    endif()
+
+    set(build_dir "${WORK_DIR}/${variant}")
+    execute_process(COMMAND "${CMAKE_COMMAND}" -S "${PROJECT_DIR}" -B "${build_dir}"
+                            -DCMAKE_BUILD_TYPE=Release -DPFD_TARGET=${target}
+                            -DPFD_PRECOMPILE_HEADER=${pch}
+                    RESULT_VARIABLE result OUTPUT_QUIET)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "Configuring ${build_dir} failed")
+    endif()
+
+    timed_build(clean "${build_dir}")
+    file(TOUCH "${PROJECT_DIR}/file1.cpp")
+    timed_build(one "${build_dir}")
+
+    # Right-align both times in their columns
+    set(line "${variant}")
+    foreach(column "${clean}:37" "${one}:47")
+        string(REPLACE ":" ";" column "${column}")
+        list(GET column 0 value)
+        list(GET column 1 width)
+        string(LENGTH "${line}${value}" length)
+        math(EXPR padding "${width} - ${length}")
+        string(REPEAT " " ${padding} spaces)
+        string(APPEND line "${spaces}${value}")
+    endforeach()
+    message("${line}")
+endforeach()
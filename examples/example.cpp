@@ -25,6 +25,9 @@ int main()
     // Set verbosity to true
     pfd::settings::verbose(true);
 
+    // Look for desktop helpers in the background while the app starts
+    pfd::settings::prewarm();
+
     // Notification
     pfd::notify("Important Notification",
                 "This is ' a message, pay \" attention \\ to it!",
@@ -69,7 +72,14 @@ void api()
 {
     // pfd::settings
     pfd::settings::verbose(true);
+    pfd::settings::prewarm();
     pfd::settings::rescan();
+    pfd::settings::reactor(true);
+    pfd::settings::scan_cache(false);
+    pfd::settings::backend(pfd::backend::zenity);
+    pfd::settings::backend(pfd::backend::kdialog, "/usr/bin/kdialog");
+    pfd::settings::backend(pfd::backend::tty);
+    pfd::settings::backend(pfd::backend::automatic);
 
     // pfd::notify
     pfd::notify("", "");
@@ -98,6 +108,51 @@ void api()
     pfd::message b("", "");
     (void)b.ready();
     (void)b.ready(42);
+    (void)b.ready(std::chrono::steady_clock::now() + std::chrono::milliseconds(16));
+    (void)b.native_handle();
     (void)b.result();
+    b.cancel();
+    b.on_drop(pfd::drop_policy::block);
+    b.on_drop(pfd::drop_policy::kill);
+    b.on_drop(pfd::drop_policy::detach);
+    b.timeout(42);
+    b.timeout(42, pfd::button::ok);
+    pfd::open_file("").timeout(42, { "/tmp/a", "/tmp/b" });
+    pfd::save_file("").timeout(42, "/tmp/a");
+    pfd::select_folder("").timeout(42);
+
+    // Reusable dialog specs
+    pfd::file_dialog_spec c("", { "Text Files", "*.txt" }, pfd::opt::multiselect);
+    pfd::open_file e(c);
+    pfd::open_file(c, "/tmp");
+    pfd::save_file(c, "/tmp/a");
+    pfd::select_folder(c, "/tmp");
+    pfd::message_spec d("", pfd::choice::yes_no, pfd::icon::question);
+    pfd::message(d, "");
+
+    // Completion callbacks
+    pfd::callback_queue queue;
+    b.then([](pfd::button) {});
+    b.then([](pfd::button) {}, &queue);
+    // A temporary dialog would wait for the user in its destructor, unless
+    // it is detached
+    pfd::open_file("").then([](std::vector<std::string>) {}).on_drop(pfd::drop_policy::detach);
+    pfd::save_file("").then([](std::string) {}).on_drop(pfd::drop_policy::detach);
+    pfd::select_folder("").then([](std::string) {}, &queue).on_drop(pfd::drop_policy::detach);
+    (void)queue.run();
+    (void)queue.run(42);
+
+    // Waiting for several dialogs
+    (void)pfd::wait_any({ &a, &b });
+    (void)pfd::wait_any({ &a, &b }, 42);
+    (void)pfd::wait_all({ &a, &b });
+    (void)pfd::wait_all({ &a, &b }, 42);
+    (void)pfd::wait_any({ &a, &b }, std::chrono::steady_clock::now());
+    (void)pfd::wait_all({ &a, &b }, std::chrono::steady_clock::now());
+
+    // Polling for completed dialogs
+    b.track(&b);
+    for (void *tag : pfd::poll_completed())
+        (void)tag;
 }
 
@@ -0,0 +1,85 @@
+//
+//  Portable File Dialogs
+//
+//  Copyright © 2018—2019 Sam Hocevar <sam@hocevar.net>
+//
+//  This program is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+//
+//  Measure how long result() takes to return once the helper is done,
+//  with each dialog polling its own helper and with the reactor thread.
+//  A stub helper answers after 50 ms and writes down the time just before
+//  it exits. This needs a display, since no helper is started otherwise.
+//
+
+#include "portable-file-dialogs.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if !_WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define RUN_COUNT 20
+
+int main()
+{
+#if !_WIN32
+    char dir[] = "/tmp/pfd-latency-XXXXXX";
+    if (!mkdtemp(dir))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string helper = std::string(dir) + "/zenity";
+    std::string stamp = helper + ".exit";
+    std::ofstream(helper) << "#!/bin/sh\nsleep 0.05\ndate +%s%N >\"$0.exit\"\n";
+    chmod(helper.c_str(), 0755);
+    pfd::settings::backend(pfd::backend::zenity, helper);
+
+    printf("µs from helper exit     median      max\n");
+    for (bool reactor : { false, true })
+    {
+        pfd::settings::reactor(reactor);
+        std::vector<double> latencies;
+        for (int i = 0; i < RUN_COUNT; ++i)
+        {
+            unlink(stamp.c_str());
+            pfd::message("Latency", "Measuring", pfd::choice::ok).result();
+            auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+
+            long long exit_ns = 0;
+            std::ifstream(stamp) >> exit_ns;
+            if (exit_ns == 0)
+            {
+                fprintf(stderr, "The helper did not run; is there a display?\n");
+                return 1;
+            }
+            latencies.push_back((now - exit_ns) / 1000.0);
+        }
+        std::sort(latencies.begin(), latencies.end());
+        printf("%-20s %9.0f %9.0f\n", reactor ? "reactor" : "polling",
+               latencies[latencies.size() / 2], latencies.back());
+    }
+
+    unlink(stamp.c_str());
+    unlink(helper.c_str());
+    rmdir(dir);
+#else
+    printf("This benchmark needs a POSIX system.\n");
+#endif
+    return 0;
+}
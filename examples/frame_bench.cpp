@@ -0,0 +1,117 @@
+//
+//  Portable File Dialogs
+//
+//  Copyright © 2018—2019 Sam Hocevar <sam@hocevar.net>
+//
+//  This program is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+//
+//  Measure what checking on pending dialogs costs a frame loop: a single
+//  poll_completed() call for tracked dialogs, against ready(0) on each of
+//  as many untracked dialogs, with and without the reactor thread. The dialogs run a stub
+//  helper that never answers while we measure. This needs a display,
+//  since no helper is started otherwise.
+//
+
+#include "portable-file-dialogs.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if !_WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define POLL_FRAMES 1000000
+#define READY_FRAMES 1000
+
+// The average time one frame takes, in microseconds
+static double measure(int count, std::function<void()> const &frame)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i)
+        frame();
+    std::chrono::duration<double, std::micro> d = std::chrono::steady_clock::now() - start;
+    return d.count() / count;
+}
+
+int main()
+{
+#if !_WIN32
+    char dir[] = "/tmp/pfd-frame-XXXXXX";
+    if (!mkdtemp(dir))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string helper = std::string(dir) + "/zenity";
+    std::ofstream(helper) << "#!/bin/sh\nexec sleep 60\n";
+    chmod(helper.c_str(), 0755);
+    pfd::settings::backend(pfd::backend::zenity, helper);
+
+    printf("µs per frame          poll_completed  ready(0) each\n");
+    for (bool reactor : { false, true })
+    {
+        pfd::settings::reactor(reactor);
+        for (int pending : { 0, 10, 100 })
+        {
+            // Tracked dialogs are watched by another thread, so only the
+            // untracked ones have ready(0) check on their helper itself
+            std::vector<std::unique_ptr<pfd::message>> tracked, dialogs;
+            for (int i = 0; i < 2 * pending; ++i)
+            {
+                auto &list = i < pending ? tracked : dialogs;
+                list.emplace_back(new pfd::message("Frame", "Measuring"));
+                list.back()->on_drop(pfd::drop_policy::kill);
+                if (i < pending)
+                    list.back()->track(list.back().get());
+            }
+            if (pending && dialogs.front()->ready(0))
+            {
+                fprintf(stderr, "The helper did not run; is there a display?\n");
+                return 1;
+            }
+
+            size_t completed = 0;
+            double poll_us = measure(POLL_FRAMES, [&completed]()
+            {
+                completed += pfd::poll_completed().size();
+            });
+            double ready_us = measure(READY_FRAMES, [&dialogs, &completed]()
+            {
+                for (auto &d : dialogs)
+                    completed += d->ready(0);
+            });
+            if (completed)
+                fprintf(stderr, "%zu dialogs completed while measuring\n", completed);
+
+            printf("%-7s %3d pending %14.4f %14.2f\n", reactor ? "reactor" : "polling",
+                   pending, poll_us, ready_us);
+
+            // Killed dialogs are reported too, so keep them out of the next
+            // measurement
+            tracked.clear();
+            dialogs.clear();
+            pfd::poll_completed();
+        }
+    }
+
+    unlink(helper.c_str());
+    rmdir(dir);
+#else
+    printf("This benchmark needs a POSIX system.\n");
+#endif
+    return 0;
+}
@@ -0,0 +1,161 @@
+//
+//  Portable File Dialogs
+//
+//  Copyright © 2018—2019 Sam Hocevar <sam@hocevar.net>
+//
+//  This program is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+//
+//  Fire a burst of notifications at a stub helper that stays up for two
+//  seconds like a popup, and check that firing them does not wait for the
+//  helpers, that every helper gets reaped, and that no fd is leaked. Exits
+//  with a non-zero status if any check fails.
+//
+
+#include "portable-file-dialogs.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#if __linux__
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define NOTIFY_COUNT 1000
+// Generous bounds: each notification costs about one posix_spawnp()
+#define MAX_FIRE_MS (NOTIFY_COUNT * 5)
+#define MAX_REAP_MS 15000
+
+#if __linux__
+// The number of entries in a /proc directory, “.” and “..” excluded
+static int count_entries(char const *path)
+{
+    int ret = -2;
+    DIR *dir = opendir(path);
+    if (!dir)
+        return -1;
+    while (readdir(dir))
+        ++ret;
+    closedir(dir);
+    return ret;
+}
+
+// Our children, exited or not, found by their parent pid
+static int count_children()
+{
+    int ret = 0;
+    DIR *dir = opendir("/proc");
+    if (!dir)
+        return -1;
+    while (auto entry = readdir(dir))
+    {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9')
+            continue;
+        std::ifstream f(std::string("/proc/") + entry->d_name + "/stat");
+        std::string stat;
+        std::getline(f, stat);
+        // The command name may hold spaces, so skip past its parenthesis
+        auto pos = stat.rfind(')');
+        if (pos == std::string::npos)
+            continue;
+        char state;
+        int ppid;
+        if (sscanf(stat.c_str() + pos + 1, " %c %d", &state, &ppid) == 2 && ppid == getpid())
+            ++ret;
+    }
+    closedir(dir);
+    return ret;
+}
+
+// Wait until all our children are reaped, and return how long it took
+static long wait_for_children()
+{
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [&start]()
+    {
+        return (long)std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    };
+    while (count_children() > 0 && elapsed() < MAX_REAP_MS)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return elapsed();
+}
+#endif
+
+int main()
+{
+#if __linux__
+    char dir[] = "/tmp/pfd-notify-XXXXXX";
+    if (!mkdtemp(dir))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string helper = std::string(dir) + "/zenity";
+    std::ofstream(helper) << "#!/bin/sh\nsleep 2\n";
+    chmod(helper.c_str(), 0755);
+    pfd::settings::backend(pfd::backend::zenity, helper);
+
+    // The first notification starts the library’s own threads and fds
+    pfd::notify("Warm-up", "Warming up");
+    wait_for_children();
+    int fds_before = count_entries("/proc/self/fd");
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < NOTIFY_COUNT; ++i)
+        pfd::notify("Notification " + std::to_string(i + 1), "Stress test");
+    long fire_ms = (long)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    int running = count_children();
+
+    long reap_ms = wait_for_children();
+    int children = count_children();
+    int fds_after = count_entries("/proc/self/fd");
+
+    unlink(helper.c_str());
+    rmdir(dir);
+
+    printf("fired %d notifications in %ld ms (%.0f µs each)\n",
+           NOTIFY_COUNT, fire_ms, fire_ms * 1000.0 / NOTIFY_COUNT);
+    printf("%d helpers still running, all gone %ld ms later, %d left\n",
+           running, reap_ms, children);
+    printf("fds: %d before, %d after\n", fds_before, fds_after);
+
+    bool ok = true;
+    if (running == 0)
+    {
+        fprintf(stderr, "FAIL: no helper was started; is there a display?\n");
+        ok = false;
+    }
+    if (fire_ms > MAX_FIRE_MS)
+    {
+        fprintf(stderr, "FAIL: firing took more than %d ms\n", MAX_FIRE_MS);
+        ok = false;
+    }
+    if (children != 0)
+    {
+        fprintf(stderr, "FAIL: %d helpers were not reaped\n", children);
+        ok = false;
+    }
+    if (fds_after != fds_before)
+    {
+        fprintf(stderr, "FAIL: %d fds leaked\n", fds_after - fds_before);
+        ok = false;
+    }
+    return ok ? 0 : 1;
+#else
+    printf("This stress test needs Linux’s /proc.\n");
+    return 0;
+#endif
+}
@@ -0,0 +1,68 @@
+//
+//  Portable File Dialogs
+//
+//  Copyright © 2018—2019 Sam Hocevar <sam@hocevar.net>
+//
+//  This program is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+//
+//  Drive many dialogs from a single poll() loop, the way an application
+//  with its own event loop would: no thread ever sleeps in pfd.
+//
+
+#include "portable-file-dialogs.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+
+#define DIALOG_COUNT 24
+
+int main()
+{
+    std::vector<pfd::message> dialogs;
+    std::vector<struct pollfd> fds;
+
+    for (int i = 0; i < DIALOG_COUNT; ++i)
+    {
+        dialogs.emplace_back("Dialog " + std::to_string(i + 1),
+                             "Close these in any order.",
+                             pfd::choice::ok_cancel, pfd::icon::info);
+
+        int fd = dialogs.back().native_handle();
+        if (fd == -1)
+        {
+            std::cerr << "Pollable dialogs are not supported here.\n";
+            return 1;
+        }
+        fds.push_back({ fd, POLLIN, 0 });
+    }
+
+    for (size_t pending = dialogs.size(); pending > 0; )
+    {
+        if (poll(fds.data(), fds.size(), -1) <= 0)
+            continue;
+
+        for (size_t i = 0; i < fds.size(); ++i)
+        {
+            if (!(fds[i].revents & POLLIN))
+                continue;
+
+            // The dialog is done, so result() returns immediately
+            auto button = dialogs[i].result();
+            std::cout << "Dialog " << i + 1 << ": "
+                      << (button == pfd::button::ok ? "ok" : "cancel") << "\n";
+
+            // A negative descriptor is ignored by poll()
+            fds[i].fd = -1;
+            --pending;
+        }
+    }
+}
@@ -0,0 +1,265 @@
+//
+//  Portable File Dialogs
+//
+//  Copyright © 2018—2019 Sam Hocevar <sam@hocevar.net>
+//
+//  This program is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+//
+//  Check that helpers get the same arguments as before they were spawned
+//  without a shell, and that quoting gives the same bytes as it did with
+//  std::regex. Random strings heavy in quotes, backslashes and UTF-8 go
+//  through the old regex quoting and the new one, and random messages go
+//  through the old zenity and kdialog command lines, split by /bin/sh, and
+//  through the new argument lists. Then time both quotings on a large
+//  message. Exits with a non-zero status on any difference.
+//
+
+#include "portable-file-dialogs.h"
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+#define QUOTE_COUNT 200000
+#define COMMAND_COUNT 2000
+#define LARGE_SIZE (1 << 20)
+
+// Dialogs that only build commands; the one dialog each of them starts
+// runs true(1) instead of a helper, and is gone at once
+class quote_fuzz : public pfd::message
+{
+public:
+    quote_fuzz() : pfd::message("", "") { result(); }
+
+    std::vector<std::string> command(std::string const &title, std::string const &text,
+                                     pfd::choice _choice, pfd::icon _icon) const
+    {
+        pfd::internal::int_map<pfd::button> mappings;
+        return helper_command(title, text, _choice, _icon, nullptr, mappings);
+    }
+
+    using pfd::message::osascript_quote;
+    using pfd::message::powershell_quote;
+    using pfd::message::shell_quote;
+};
+
+// The quoting functions as they were with std::regex
+static std::string old_powershell_quote(std::string const &str)
+{
+    return "'" + std::regex_replace(str, std::regex("['\"]"), "$&$&") + "'";
+}
+
+static std::string old_osascript_quote(std::string const &str)
+{
+    return "\"" + std::regex_replace(str, std::regex("[\\\\\"]"), "\\$&") + "\"";
+}
+
+static std::string old_shell_quote(std::string const &str)
+{
+    return "'" + std::regex_replace(str, std::regex("'"), "'\\''") + "'";
+}
+
+static std::string old_icon_name(pfd::icon _icon)
+{
+    switch (_icon)
+    {
+        case pfd::icon::warning: return "warning";
+        case pfd::icon::error: return "error";
+        case pfd::icon::question: return "question";
+        default: return "information";
+    }
+}
+
+// The message command line as it was built for the shell, minus the
+// helper name
+static std::string old_zenity_message(std::string const &title, std::string const &text,
+                                      pfd::choice _choice, pfd::icon _icon)
+{
+    std::string command;
+    switch (_choice)
+    {
+        case pfd::choice::ok_cancel:
+            command += " --question --ok-label=OK --cancel-label=Cancel"; break;
+        case pfd::choice::yes_no:
+            command += " --question --switch --extra-button No --extra-button Yes"; break;
+        case pfd::choice::yes_no_cancel:
+            command += " --question --switch --extra-button No --extra-button Yes --extra-button Cancel"; break;
+        case pfd::choice::retry_cancel:
+            command += " --question --switch --extra-button Retry --extra-button Cancel"; break;
+        case pfd::choice::abort_retry_ignore:
+            command += " --question --switch --extra-button Abort --extra-button Retry --extra-button Ignore"; break;
+        default:
+            switch (_icon)
+            {
+                case pfd::icon::error: command += " --error"; break;
+                case pfd::icon::warning: command += " --warning"; break;
+                default: command += " --info"; break;
+            }
+    }
+    return command + " --title " + old_shell_quote(title)
+                   + " --width 300 --height 0"
+                   + " --text " + old_shell_quote(text)
+                   + " --icon-name=dialog-" + old_icon_name(_icon);
+}
+
+static std::string old_kdialog_message(std::string const &title, std::string const &text,
+                                       pfd::choice _choice, pfd::icon _icon)
+{
+    std::string command;
+    if (_choice == pfd::choice::ok)
+    {
+        switch (_icon)
+        {
+            case pfd::icon::error: command += " --error"; break;
+            case pfd::icon::warning: command += " --sorry"; break;
+            default: command += " --msgbox"; break;
+        }
+    }
+    else
+    {
+        command += " --";
+        if (_icon == pfd::icon::warning || _icon == pfd::icon::error)
+            command += "warning";
+        command += "yesno";
+        if (_choice == pfd::choice::yes_no_cancel)
+            command += "cancel";
+    }
+    command += " " + old_shell_quote(text) + " --title " + old_shell_quote(title);
+    if (_choice == pfd::choice::ok_cancel)
+        command += " --yes-label OK --no-label Cancel";
+    return command;
+}
+
+// The arguments /bin/sh splits a command line into
+static std::vector<std::string> shell_split(std::string const &args)
+{
+    std::vector<std::string> ret;
+    FILE *f = popen(("printf '%s\\0'" + args).c_str(), "r");
+    if (!f)
+        return ret;
+    std::string arg;
+    for (int c; (c = fgetc(f)) != EOF; )
+    {
+        if (c)
+            arg += char(c);
+        else
+            ret.push_back(arg), arg.clear();
+    }
+    pclose(f);
+    return ret;
+}
+
+static std::string random_string(std::mt19937 &rng, bool allow_nul)
+{
+    static char const *const pieces[] =
+    {
+        "'", "\"", "\\", "$", "`", "!", "*", " ", "\n", "\t", "-", "--",
+        "a", "Z", "0", "é", "€", "😀", "'\\''", "\"\"", "\\\\",
+    };
+    size_t count = sizeof(pieces) / sizeof(*pieces);
+    std::string ret;
+    for (size_t n = rng() % 24; n > 0; --n)
+    {
+        if (allow_nul && rng() % 32 == 0)
+            ret += '\0';
+        else
+            ret += pieces[rng() % count];
+    }
+    return ret;
+}
+
+// The average time one call takes, in microseconds
+static double measure(int count, std::function<void()> const &f)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i)
+        f();
+    std::chrono::duration<double, std::micro> d = std::chrono::steady_clock::now() - start;
+    return d.count() / count;
+}
+
+int main()
+{
+    int errors = 0;
+    std::mt19937 rng(42);
+
+#if !_WIN32
+    pfd::settings::backend(pfd::backend::zenity, "/bin/true");
+#endif
+    quote_fuzz q;
+
+    for (int i = 0; i < QUOTE_COUNT; ++i)
+    {
+        auto str = random_string(rng, true);
+        if (q.shell_quote(str) != old_shell_quote(str)
+             || q.osascript_quote(str) != old_osascript_quote(str)
+             || q.powershell_quote(str) != old_powershell_quote(str))
+        {
+            if (errors++ < 10)
+                fprintf(stderr, "quoting differs for “%s”\n", str.c_str());
+        }
+    }
+    printf("%d strings quoted the same by the old and new code\n", QUOTE_COUNT);
+
+#if !_WIN32
+    // Each helper gets its own dialog, since a dialog keeps the helper it
+    // was built for; arguments cannot hold a NUL, unlike quoted strings
+    for (auto helper : { pfd::backend::zenity, pfd::backend::kdialog })
+    {
+        pfd::settings::backend(helper, "/bin/true");
+        quote_fuzz h;
+        for (int i = 0; i < COMMAND_COUNT; ++i)
+        {
+            auto title = random_string(rng, false);
+            auto text = random_string(rng, false);
+            auto _choice = pfd::choice(rng() % 6);
+            auto _icon = pfd::icon(rng() % 4);
+
+            auto args = h.command(title, text, _choice, _icon);
+            args.erase(args.begin());
+            auto old_args = shell_split(helper == pfd::backend::zenity
+                                        ? old_zenity_message(title, text, _choice, _icon)
+                                        : old_kdialog_message(title, text, _choice, _icon));
+            if (args != old_args)
+            {
+                if (errors++ < 10)
+                    fprintf(stderr, "arguments differ for “%s”, “%s”\n",
+                            title.c_str(), text.c_str());
+            }
+        }
+    }
+    printf("%d messages got the same arguments as from the shell\n", 2 * COMMAND_COUNT);
+#endif
+
+    // A large message with a quote every 64 bytes
+    std::string large(LARGE_SIZE, 'a');
+    for (size_t i = 0; i < large.size(); i += 64)
+        large[i] = i % 128 ? '\'' : '"';
+    auto mb_per_s = [](double us) { return LARGE_SIZE / us; };
+
+    double shell_old = measure(10, [&]() { old_shell_quote(large); });
+    double shell_new = measure(100, [&]() { q.shell_quote(large); });
+    double osascript_old = measure(10, [&]() { old_osascript_quote(large); });
+    double osascript_new = measure(100, [&]() { q.osascript_quote(large); });
+    double powershell_old = measure(10, [&]() { old_powershell_quote(large); });
+    double powershell_new = measure(100, [&]() { q.powershell_quote(large); });
+
+    printf("MB/s on 1 MiB      regex      new\n");
+    printf("shell_quote     %8.1f %8.1f\n", mb_per_s(shell_old), mb_per_s(shell_new));
+    printf("osascript_quote %8.1f %8.1f\n", mb_per_s(osascript_old), mb_per_s(osascript_new));
+    printf("powershell_quote%8.1f %8.1f\n", mb_per_s(powershell_old), mb_per_s(powershell_new));
+
+    if (errors)
+        fprintf(stderr, "FAIL: %d differences\n", errors);
+    return errors ? 1 : 0;
+}
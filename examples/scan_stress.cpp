@@ -0,0 +1,113 @@
+//
+//  Portable File Dialogs
+//
+//  Copyright © 2018—2019 Sam Hocevar <sam@hocevar.net>
+//
+//  This program is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+//
+//  Build thousands of dialogs from many threads at once against a stub
+//  helper that answers immediately, while other threads keep rescanning
+//  the system and switching the reactor on and off. The Makefile builds
+//  this with ThreadSanitizer, which reports any data race it runs into.
+//
+
+#include "portable-file-dialogs.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !_WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define THREAD_COUNT 8
+#define DIALOG_COUNT 250
+
+int main()
+{
+#if !_WIN32
+    // Put a stub zenity first in the PATH, so that every scan finds it
+    char dir[] = "/tmp/pfd-stress-XXXXXX";
+    if (!mkdtemp(dir))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string helper = std::string(dir) + "/zenity";
+    std::ofstream(helper) << "#!/bin/sh\necho\n";
+    chmod(helper.c_str(), 0755);
+    char const *path = getenv("PATH");
+    setenv("PATH", (std::string(dir) + ":" + (path ? path : "")).c_str(), 1);
+    pfd::settings::scan_cache(false);
+
+    std::atomic<bool> done(false);
+    std::atomic<int> answers(0), callbacks(0);
+
+    // Rescans drop the published result while dialogs are reading it
+    std::thread rescanner([&done]()
+    {
+        while (!done)
+        {
+            pfd::settings::rescan();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    std::thread switcher([&done]()
+    {
+        for (bool on = true; !done; on = !on)
+        {
+            pfd::settings::reactor(on);
+            pfd::settings::prewarm();
+            std::this_thread::sleep_for(std::chrono::milliseconds(3));
+        }
+    });
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < THREAD_COUNT; ++t)
+        workers.emplace_back([&answers, &callbacks, t]()
+        {
+            for (int i = 0; i < DIALOG_COUNT; ++i)
+            {
+                auto title = "Dialog " + std::to_string(t) + "." + std::to_string(i);
+                if (i % 2)
+                {
+                    pfd::message(title, "Stress test", pfd::choice::yes_no).result();
+                    ++answers;
+                }
+                else
+                {
+                    pfd::message(title, "Stress test", pfd::choice::yes_no)
+                        .then([&callbacks](pfd::button) { ++callbacks; });
+                }
+            }
+        });
+
+    for (auto &w : workers)
+        w.join();
+    done = true;
+    rescanner.join();
+    switcher.join();
+
+    unlink(helper.c_str());
+    rmdir(dir);
+
+    printf("%d dialogs answered, %d callbacks run\n", answers.load(), callbacks.load());
+    return answers + callbacks == THREAD_COUNT * DIALOG_COUNT ? 0 : 1;
+#else
+    printf("This stress test needs a POSIX system.\n");
+    return 0;
+#endif
+}
@@ -0,0 +1,159 @@
+//
+//  Portable File Dialogs
+//
+//  Copyright © 2018—2019 Sam Hocevar <sam@hocevar.net>
+//
+//  This program is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+//
+//  Measure how long starting a dialog’s helper takes, against popen() of
+//  the same command line as helpers used to be started, while the process
+//  holds more and more memory and open fds. A stub helper that answers at
+//  once stands in for zenity. This needs a display, since no helper is
+//  started otherwise. Pass the resident sizes to try, in MiB; the default
+//  is 16 256 4096.
+//
+
+#include "portable-file-dialogs.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#if !_WIN32
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define SPAWN_COUNT 50
+#define FD_COUNT 5000
+
+#if !_WIN32
+// The median time one start takes, in microseconds
+static double measure(std::function<void()> const &start, std::function<void()> const &finish)
+{
+    std::vector<double> times;
+    for (int i = 0; i < SPAWN_COUNT; ++i)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        start();
+        std::chrono::duration<double, std::micro> d = std::chrono::steady_clock::now() - t0;
+        finish();
+        times.push_back(d.count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+#if !_WIN32
+    std::vector<size_t> sizes;
+    for (int i = 1; i < argc; ++i)
+        sizes.push_back(size_t(atol(argv[i])));
+    if (sizes.empty())
+        sizes = { 16, 256, 4096 };
+
+    char dir[] = "/tmp/pfd-spawn-XXXXXX";
+    if (!mkdtemp(dir))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string helper = std::string(dir) + "/zenity";
+    std::ofstream(helper) << "#!/bin/sh\necho\n";
+    chmod(helper.c_str(), 0755);
+    pfd::settings::backend(pfd::backend::zenity, helper);
+
+    // The same dialog through popen(), with the arguments quoted for the
+    // shell the way they used to be
+    std::string line = "'" + helper + "' --info --title 'Spawn' --width 300 --height 0"
+                       " --text 'Measuring' --icon-name=dialog-information";
+
+    std::unique_ptr<pfd::message> dialog;
+    auto start = [&dialog]()
+    {
+        dialog.reset(new pfd::message("Spawn", "Measuring", pfd::choice::ok));
+    };
+    auto finish = [&dialog]()
+    {
+        dialog->result();
+        dialog.reset();
+    };
+    FILE *pipe = nullptr;
+    auto popen_start = [&pipe, &line]() { pipe = popen(line.c_str(), "r"); };
+    auto popen_finish = [&pipe]() { pclose(pipe); };
+
+    // A first dialog, so that the scan and the library’s threads are not
+    // part of the measurement; it also checks that a helper can start
+    start();
+    if (dialog->result() != pfd::button::ok)
+    {
+        fprintf(stderr, "The helper did not run; is there a display?\n");
+        return 1;
+    }
+    dialog.reset();
+
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    printf("µs per start, median     pfd    popen\n");
+    for (size_t size : sizes)
+    {
+        // Touch every page, so that it is really resident
+        std::vector<char> memory;
+        try
+        {
+            memory.resize(size << 20);
+            memset(memory.data(), 1, memory.size());
+        }
+        catch (std::bad_alloc const &)
+        {
+            printf("%5zu MiB: cannot allocate\n", size);
+            continue;
+        }
+
+        for (int fd_count : { 0, FD_COUNT })
+        {
+            std::vector<int> fds;
+            for (int i = 0; i < fd_count; ++i)
+            {
+                int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+                if (fd == -1)
+                    break;
+                fds.push_back(fd);
+            }
+
+            double pfd_us = measure(start, finish);
+            double popen_us = measure(popen_start, popen_finish);
+            printf("%5zu MiB, %5zu more fds %8.0f %8.0f\n",
+                   size, fds.size(), pfd_us, popen_us);
+
+            for (int fd : fds)
+                close(fd);
+        }
+    }
+
+    unlink(helper.c_str());
+    rmdir(dir);
+#else
+    printf("This benchmark needs a POSIX system.\n");
+#endif
+    return 0;
+}
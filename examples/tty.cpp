@@ -0,0 +1,190 @@
+//
+//  Portable File Dialogs
+//
+//  Copyright © 2018—2019 Sam Hocevar <sam@hocevar.net>
+//
+//  This program is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+//
+//  Check the terminal backend without a user: a child process asks its
+//  dialogs on a pseudo-terminal, and we type the answers on the other end.
+//  Exits with a non-zero status if any answer is not the expected one.
+//
+
+#include "portable-file-dialogs.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+// The dialogs, run in the child with the pseudo-terminal as its terminal;
+// each answer is written to out as a line
+static void ask(std::string const &dir, FILE *out)
+{
+    pfd::settings::backend(pfd::backend::tty);
+
+    auto b = pfd::message("Question", "Save changes?", pfd::choice::yes_no).result();
+    fprintf(out, "message %d\n", int(b));
+
+    b = pfd::message("Quit", "Really quit?", pfd::choice::ok_cancel).result();
+    fprintf(out, "escape %d\n", int(b));
+
+    auto files = pfd::open_file("Open", dir + "/", { "Text Files", "*.txt" }).result();
+    fprintf(out, "open %s\n", files.empty() ? "" : files[0].c_str());
+
+    auto folder = pfd::select_folder("Folder", dir).result();
+    fprintf(out, "folder %s\n", folder.c_str());
+
+    auto file = pfd::save_file("Save", dir + "/beta.txt").result();
+    fprintf(out, "save %s\n", file.c_str());
+
+    // Nobody answers this one; the terminal must be restored anyway
+    pfd::open_file cancelled("Cancelled", dir);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    cancelled.cancel();
+    files = cancelled.result();
+    struct termios attr;
+    int fd = open("/dev/tty", O_RDWR);
+    bool restored = tcgetattr(fd, &attr) == 0 && (attr.c_lflag & ECHO) && (attr.c_lflag & ICANON);
+    close(fd);
+    fprintf(out, "cancel %d %d\n", int(files.size()), int(restored));
+}
+
+// Read the terminal until it shows some text, or a few seconds went by
+static bool wait_for(int master, std::string const &text, std::string &screen)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (screen.find(text) == std::string::npos)
+    {
+        if (std::chrono::steady_clock::now() >= deadline)
+            return false;
+        struct pollfd fd = { master, POLLIN, 0 };
+        char buf[256];
+        ssize_t len;
+        if (poll(&fd, 1, 50) > 0 && (len = read(master, buf, sizeof(buf))) > 0)
+            screen.append(buf, size_t(len));
+    }
+    screen.erase(0, screen.find(text) + text.size());
+    return true;
+}
+
+int main()
+{
+    char dir_template[] = "/tmp/pfd-tty-XXXXXX";
+    std::string dir = mkdtemp(dir_template);
+    for (auto name : { "alpha.txt", "beta.txt" })
+        close(open((dir + "/" + name).c_str(), O_CREAT | O_WRONLY, 0644));
+    mkdir((dir + "/gamma").c_str(), 0755);
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master == -1 || grantpt(master) != 0 || unlockpt(master) != 0)
+    {
+        std::cerr << "Pseudo-terminals are not supported here.\n";
+        return 1;
+    }
+
+    int fds[2];
+    if (pipe(fds) != 0)
+        return 1;
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        // Make the pseudo-terminal our controlling terminal
+        setsid();
+        int slave = open(ptsname(master), O_RDWR);
+        ioctl(slave, TIOCSCTTY, 0);
+        close(master);
+        close(fds[0]);
+        FILE *out = fdopen(fds[1], "w");
+        setvbuf(out, nullptr, _IOLBF, 0);
+        ask(dir, out);
+        _exit(0);
+    }
+    close(fds[1]);
+
+    // What to wait for on the terminal, and what to type then; the terminal
+    // turns line feeds into CR LF, so only match text within lines
+    struct { char const *prompt, *keys; } const script[] =
+    {
+        { "[N]o ", "n" },
+        { "[C]ancel ", "\x1b" },
+        { "Open", "al\t\r" },
+        { "Folder", "g\t\r" },
+        { "Save", "\r" },
+        { "[y/N] ", "y" },
+        { "Cancelled", "" },
+    };
+
+    std::string screen;
+    bool ok = true;
+    for (auto const &step : script)
+    {
+        if (!wait_for(master, step.prompt, screen))
+        {
+            std::cout << "Timed out waiting for “" << step.prompt << "”, got “" << screen << "”\n";
+            ok = false;
+            break;
+        }
+        if (write(master, step.keys, strlen(step.keys)) < 0)
+            ok = false;
+    }
+
+    // Keep draining the terminal, so that the child never blocks on it
+    std::string answers;
+    for (;;)
+    {
+        struct pollfd pfds[2] = { { fds[0], POLLIN, 0 }, { master, POLLIN, 0 } };
+        if (poll(pfds, 2, 5000) <= 0)
+            break;
+        char buf[256];
+        if (pfds[1].revents && read(master, buf, sizeof(buf)) <= 0)
+            pfds[1].fd = -1;
+        if (!pfds[0].revents)
+            continue;
+        ssize_t len = read(fds[0], buf, sizeof(buf));
+        if (len <= 0)
+            break;
+        answers.append(buf, size_t(len));
+    }
+    // The child is stuck in a dialog if we could not answer it
+    if (!ok)
+        kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+
+    std::string const expected[] =
+    {
+        "message " + std::to_string(int(pfd::button::no)),
+        "escape " + std::to_string(int(pfd::button::cancel)),
+        "open " + dir + "/alpha.txt",
+        "folder " + dir + "/gamma",
+        "save " + dir + "/beta.txt",
+        "cancel 0 1",
+    };
+    for (auto const &line : expected)
+    {
+        bool found = answers.find(line + "\n") != std::string::npos;
+        std::cout << (found ? "ok: " : "FAILED: ") << line << "\n";
+        ok = ok && found;
+    }
+
+    for (auto name : { "/alpha.txt", "/beta.txt", "/gamma", "" })
+        remove((dir + name).c_str());
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,19 @@
+//
+//  Portable File Dialogs
+//
+//  Copyright © 2018—2019 Sam Hocevar <sam@hocevar.net>
+//
+//  This library is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+//
+//  The implementation, compiled once for the portable_file_dialogs_static
+//  library; its users include the header with PFD_SKIP_IMPLEMENTATION.
+//
+
+#define PFD_COMPILE_IMPLEMENTATION 1
+#include "portable-file-dialogs.h"
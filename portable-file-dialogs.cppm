@@ -0,0 +1,57 @@
+//
+//  Portable File Dialogs
+//
+//  Copyright © 2018—2019 Sam Hocevar <sam@hocevar.net>
+//
+//  This library is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+//
+//  The pfd C++20 module, built from portable-file-dialogs.h: importers see
+//  the public API only, and none of the header’s macros or system headers.
+//  The implementation is compiled here, once.
+//
+
+module;
+
+#define PFD_COMPILE_IMPLEMENTATION 1
+#include "portable-file-dialogs.h"
+
+export module pfd;
+
+export namespace pfd
+{
+
+using pfd::button;
+using pfd::choice;
+using pfd::icon;
+using pfd::opt;
+using pfd::drop_policy;
+using pfd::backend;
+using pfd::operator|;
+using pfd::operator&;
+
+using pfd::settings;
+using pfd::file_dialog_spec;
+using pfd::message_spec;
+using pfd::callback_queue;
+
+using pfd::notify;
+using pfd::message;
+using pfd::open_file;
+using pfd::save_file;
+using pfd::select_folder;
+
+using pfd::wait_any;
+using pfd::wait_all;
+using pfd::poll_completed;
+
+#if PFD_HAS_COROUTINES
+using pfd::operator co_await;
+#endif
+
+} // namespace pfd
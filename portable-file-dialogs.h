@@ -27,22 +27,79 @@
 #include <emscripten.h>
 
 #else
-#ifndef _POSIX_C_SOURCE
-#   define _POSIX_C_SOURCE 2 // for popen()
-#endif
-#include <cstdio>   // for popen()
+#include <cctype>   // for tolower()
+#include <climits>  // for PATH_MAX
 #include <cstdlib>  // for std::getenv()
+#include <cstring>  // for memcmp()
+#include <cerrno>   // for errno
+#include <dirent.h> // for opendir()
 #include <fcntl.h>  // for fcntl()
+#include <fnmatch.h> // for fnmatch()
+#include <poll.h>   // for poll()
+#include <signal.h> // for kill()
+#include <spawn.h>  // for posix_spawnp()
+#include <termios.h> // for tcsetattr()
 #include <unistd.h> // for read()
+#include <sys/mman.h> // for mmap()
+#include <sys/socket.h> // for connect()
+#include <sys/stat.h> // for stat()
+#include <sys/un.h>   // for sockaddr_un
+#include <sys/wait.h> // for waitpid()
+#if __linux__
+#include <sys/epoll.h>   // for epoll_create1()
+#include <sys/eventfd.h> // for eventfd()
+#include <sys/timerfd.h> // for timerfd_create()
+#include <sys/syscall.h> // for SYS_pidfd_open
+#endif
+#if __APPLE__
+#include <crt_externs.h> // for _NSGetEnviron()
+#else
+extern char **environ;
+#endif
+#endif
+
+// The desktop helper backend can be chosen at compile time, for instance
+// with -DPFD_BACKEND=PFD_BACKEND_ZENITY. Only that backend’s code is then
+// compiled in, and no scan for desktop helpers happens at runtime. This has
+// no effect on Windows, which always uses the Win32 API.
+#define PFD_BACKEND_AUTO      0
+#define PFD_BACKEND_OSASCRIPT 1
+#define PFD_BACKEND_ZENITY    2
+#define PFD_BACKEND_KDIALOG   3
+
+#if !defined PFD_BACKEND
+#   define PFD_BACKEND PFD_BACKEND_AUTO
+#endif
+
+#define PFD_HAS_BACKEND(x) (PFD_BACKEND == PFD_BACKEND_AUTO || PFD_BACKEND == PFD_BACKEND_##x)
+
+// Dialogs can be awaited with co_await when the compiler supports C++20
+// coroutines; define PFD_HAS_COROUTINES to 0 to disable this.
+#if !defined PFD_HAS_COROUTINES && defined __cpp_impl_coroutine && defined __has_include
+#   if __has_include(<coroutine>)
+#       define PFD_HAS_COROUTINES 1
+#   endif
+#endif
+
+#if !defined PFD_HAS_COROUTINES
+#   define PFD_HAS_COROUTINES 0
 #endif
 
 #include <string>
+#include <vector>
 #include <memory>
-#include <iostream>
-#include <map>
-#include <regex>
+#include <cstdio>
 #include <thread>
 #include <chrono>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <limits>
+#include <algorithm>
+#if PFD_HAS_COROUTINES
+#include <coroutine>
+#endif
 
 namespace pfd
 {
@@ -90,45 +147,167 @@ enum class opt : uint8_t
     force_path      = 0x4,
 };
 
+// What happens to a helper that is still running when the last copy of its
+// dialog object is destroyed
+enum class drop_policy
+{
+    // Wait for the user to close the dialog
+    block = 0,
+    // Terminate the helper, as cancel() does
+    kill,
+    // Leave the dialog open and ignore its result
+    detach,
+};
+
 inline opt operator |(opt a, opt b) { return opt(uint8_t(a) | uint8_t(b)); }
 inline bool operator &(opt a, opt b) { return bool(uint8_t(a) & uint8_t(b)); }
 
-// The settings class, only exposing to the user a way to set verbose mode
-// and to force a rescan of installed desktop helpers (zenity, kdialog…).
+// Desktop helper backends that can be forced at runtime on Linux and BSD.
+// The zenity backend also works with its clones matedialog and qarma. The
+// tty backend needs no helper: dialogs are asked on the terminal, which is
+// also what happens when there is no display or no helper.
+enum class backend
+{
+    automatic = 0,
+    zenity,
+    kdialog,
+    tty,
+};
+
+// The settings class, only exposing to the user a way to set verbose mode,
+// to scan for installed desktop helpers (zenity, kdialog…) in the background
+// ahead of the first dialog, to force a rescan of these helpers, and to
+// force a given helper instead.
 class settings
 {
 public:
     static void verbose(bool value);
+    static void prewarm();
     static void rescan();
 
+    // Watch all helpers from a single background thread instead of polling
+    // each one separately; only available on Linux.
+    static void reactor(bool value);
+
+    // Use this backend and helper instead of scanning the system. This can
+    // also be done with the PFD_BACKEND and PFD_HELPER_PATH environment
+    // variables. If the helper fails to start, we fall back to a scan.
+    static void backend(pfd::backend value, std::string const &helper_path = "");
+
+    // Whether to cache the helper scan on disk, for the next processes; it
+    // can also be disabled with PFD_SCAN_CACHE=0 in the environment
+    static void scan_cache(bool value);
+
+    // Kill a helper that still has no window five seconds after being
+    // started, e.g. because it hangs on D-Bus, and try the next one. This
+    // is only checked on a local X server, and cannot see dialogs shown by
+    // another process on the helper’s behalf, such as an XDG portal. It can
+    // also be enabled with PFD_WATCHDOG=1 in the environment.
+    static void watchdog(bool value);
+
 protected:
     explicit settings(bool resync = false);
 
-    inline bool is_osascript() const;
-    inline bool is_zenity() const;
-    inline bool is_kdialog() const;
-
     enum class flag
     {
-        is_scanned = 0,
-        is_verbose,
-
-        has_zenity,
-        has_matedialog,
-        has_qarma,
-        has_kdialog,
+        is_verbose = 0,
         is_vista,
+        is_forced_broken,
+        has_reactor,
+        no_scan_cache,
+        use_watchdog,
 
         max_flag,
     };
 
+    // Desktop helpers that we know how to drive, in order of preference
+    enum class helper
+    {
+        zenity = 0,
+        matedialog,
+        qarma,
+        kdialog,
+
+        max_helper,
+    };
+
+    // What a scan of the system found. A scan result is never modified once
+    // published, and lives as long as the dialogs that were built from it.
+    struct scan_result
+    {
+        // Absolute path of each helper, or empty if it was not found
+        std::string path[size_t(helper::max_helper)];
+        // Whether each helper may be used, after the desktop heuristics
+        bool enabled[size_t(helper::max_helper)] = {};
+        // Whether the helper was forced rather than found by a scan, in
+        // which case it is not known to work yet
+        bool is_forced = false;
+        // Whether a display server looked reachable; desktop helpers cannot
+        // work without one
+        bool has_display = true;
+        // Whether the terminal backend was forced
+        bool use_tty = false;
+    };
+
+    // Return the current scan result, scanning the system if necessary.
+    // Concurrent callers wait for a single scan instead of duplicating it.
+    static std::shared_ptr<scan_result const> scan();
+
     // Static array of flags for internal state
-    bool const &flags(flag in_flag) const;
+    static std::atomic<bool> &flags(flag in_flag);
+
+    // Give up on a forced helper that failed to start, and scan instead
+    static void forced_failed();
+
+private:
+    static scan_result scan_system();
+    static bool scan_forced(scan_result &result);
+    // Check that DISPLAY or WAYLAND_DISPLAY names a server we can connect to
+    static bool probe_display();
+
+    // Backend and helper path set by backend(), protected by scan_mutex()
+    static std::pair<pfd::backend, std::string> &forced_backend();
+    static std::vector<std::string> search_path();
+    // Look for a program; each file looked at is also appended to stamps
+    static std::string find_program(std::string const &program,
+                                    std::string *stamps = nullptr);
+    // A file’s mode and mtime, which change if it is replaced or chmod’ed,
+    // or an empty string if it does not exist
+    static std::string file_stamp(std::string const &file);
+
+    // On-disk cache of the scan result, shared by all processes of a user
+    static std::string scan_cache_dir();
+    static std::string scan_cache_key();
+    static bool load_scan_cache(std::string const &key, scan_result &result);
+    static void save_scan_cache(std::string const &key, scan_result const &result);
+
+    // The current scan result, or null until the next scan. It is only
+    // written with scan_mutex() held, but read without it by scan().
+    static std::atomic<std::shared_ptr<scan_result const> const *> &current_scan();
+    static std::mutex &scan_mutex();
+};
+
+// A queue of completion callbacks, for dialogs whose callbacks must run on
+// a given thread; that thread calls run() from its own loop. The queue must
+// outlive the dialogs that use it.
+class callback_queue
+{
+public:
+    // Run the pending callbacks, waiting up to timeout milliseconds for the
+    // first one (forever if negative); return how many were run
+    size_t run(int timeout = 0);
 
-    // Non-const getter for the static array of flags
-    bool &flags(flag in_flag);
+    void post(std::function<void()> const &callback);
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::vector<std::function<void()>> m_pending;
 };
 
+class file_dialog_spec;
+class message_spec;
+
 // Internal classes, not to be used by client applications
 namespace internal
 {
@@ -136,42 +315,423 @@ namespace internal
 // Process wait timeout, in milliseconds
 static int const default_wait_timeout = 20;
 
-class executor
+// Time given to a cancelled helper to exit after SIGTERM, before SIGKILL
+static int const kill_grace_period = 500;
+
+// A helper that exits without an answer this soon after being started, in
+// milliseconds, is assumed to have failed to show its dialog at all
+static int const helper_startup_time = 300;
+
+// A helper that still has no window this long after being started, in
+// milliseconds, is assumed to hang before showing its dialog
+static int const helper_watchdog_time = 5000;
+
+// Convert a deadline into a poll() timeout, rounding up so that we never
+// wake up early; time_point::max() means no timeout
+int timeout_until(std::chrono::steady_clock::time_point deadline);
+
+// The filters of file dialogs that were given none. Default arguments call
+// this instead of using a braced list, which GCC 12 fails to compile in a
+// co_await expression.
+std::vector<std::string> default_filters();
+
+// A map from exit codes or button ids to values. It never holds more than
+// a few entries, so a vector is just as fast as std::map, and much cheaper
+// to compile.
+template<typename T>
+class int_map
+{
+public:
+    typedef typename std::vector<std::pair<int, T>>::const_iterator const_iterator;
+
+    T &operator[](int key)
+    {
+        for (auto &it : m_items)
+            if (it.first == key)
+                return it.second;
+        m_items.emplace_back(key, T());
+        return m_items.back().second;
+    }
+
+    const_iterator find(int key) const
+    {
+        return std::find_if(begin(), end(), [key](std::pair<int, T> const &it) { return it.first == key; });
+    }
+
+    const_iterator begin() const { return m_items.begin(); }
+    const_iterator end() const { return m_items.end(); }
+    void clear() { m_items.clear(); }
+
+private:
+    std::vector<std::pair<int, T>> m_items;
+};
+
+class executor : public std::enable_shared_from_this<executor>
 {
     friend class dialog;
+    friend class reactor;
 
 public:
+    // Completion callbacks receive the helper’s output and exit code
+    typedef std::function<void(std::string const &, int)> callback;
+
     // High level function to get the result of a command
     std::string result(int *exit_code = nullptr);
 
 #if _WIN32
     void start(std::function<std::string(int *)> const &fun);
-#endif
+#else
 #if __EMSCRIPTEN__
     void start(int exit_code);
 #endif
-    void start(std::string const &command);
+    // Start the first of these helper commands that can be spawned. If it
+    // fails to show its dialog, the next ones are tried in turn. A helper
+    // that prints nothing is assumed to have printed the answer matching
+    // its exit code, if any. If they all fail, the job is run instead, as
+    // with start_job(); unless told otherwise, this includes the case where
+    // none can be spawned at all, and only then is false returned. Each
+    // command, or the job, is printed to stderr as given in the log whenever
+    // it is started. With the watchdog, a helper that shows no window in
+    // time also counts as failed, and is killed.
+    bool start_process(std::vector<std::vector<std::string>> const &commands,
+                       std::vector<int_map<std::string>> const &answers = {},
+                       std::vector<std::string> const &log = {},
+                       std::function<std::string(int)> const &job = nullptr,
+                       bool watchdog = false,
+                       bool job_if_unspawned = true);
+
+    // Run a dialog on a thread of ours instead of a helper. The job gets a
+    // socket, which hangs up if the dialog is cancelled, and returns what a
+    // helper would have printed; it exits with 0 unless that is empty.
+    bool start_job(std::function<std::string(int)> const &job);
+#endif
 
     ~executor();
 
 protected:
     bool ready(int timeout = default_wait_timeout);
+    // Wait until a deadline; time_point::max() means waiting forever
+    bool ready(std::chrono::steady_clock::time_point deadline);
     void stop();
 
+    // Hand the running helper over to the reactor thread, if possible
+    bool watch();
+
+    // An eventfd that becomes readable once the helper is done, or -1
+    int native_handle();
+
+    // Run a callback once the helper is done, or right away if it already
+    // is. Without the reactor thread, a thread is started to wait for it,
+    // and the callback runs on whichever thread notices completion first.
+    // The reactor thread never runs a callback that may block, such as a
+    // user’s, but hands it to the dispatcher’s threads instead.
+    void then(callback const &cb, bool may_block = true);
+
+    // Wait for the helper to exit and for its callbacks to have run, unless
+    // called from one of these callbacks
+    void settle();
+
+    // Terminate the helper and report the dialog as cancelled right away;
+    // a job is first given a moment to let go of the terminal
+    void cancel();
+
+    // Apply a drop policy once no dialog object uses us anymore
+    void drop(drop_policy policy);
+
+    // Terminate the helper at a deadline, and report the given output and
+    // exit code instead of its own. Not supported on Windows yet.
+    void expire_at(std::chrono::steady_clock::time_point deadline,
+                   std::string const &out, int exit_code);
+
 private:
-    bool m_running = false;
+    // Take the pending callbacks, bound to a copy of the results so that
+    // they can run once the lock is released; the lock must be held.
+    std::function<void()> take_callbacks();
+    // Run the callbacks returned by take_callbacks() with the lock released,
+    // and return false if one of them destroyed us
+    bool notify(std::unique_lock<std::mutex> &lock, std::function<void()> const &callbacks);
+
+    std::atomic<bool> m_running { false };
     std::string m_stdout;
     int m_exit_code = -1;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::vector<callback> m_callbacks;
+    // Whether one of the pending callbacks may block
+    bool m_may_block = false;
+    // Whether callbacks are running, and on which thread
+    bool m_notifying = false;
+    std::thread::id m_notifier;
+    // Set by the destructor when called from a callback
+    bool *m_destroyed = nullptr;
 #if _WIN32
     std::future<std::string> m_future;
-    PROCESS_INFORMATION m_pi;
+    // Whether the dialog is over, even if ready() was not called yet
+    bool m_done = false;
 #elif __EMSCRIPTEN__ || __NX__
     // FIXME: do something
 #else
-    FILE *m_stream = nullptr;
+    // Read the helper’s output so far, and return true at EOF
+    bool drain();
+    // Reap the helper, and return true if it exited
+    bool reap(bool block);
+    // Hand the helper over to the reactor thread; the lock must be held
+    bool watch_locked();
+    // Release the helper’s resources and wake up waiters; the returned
+    // function runs the callbacks and must be passed to notify().
+    std::function<void()> finish();
+    // Called by the reactor thread when one of our descriptors is readable
+    void update();
+    // Like notify(), but on a dispatcher thread if the callbacks may block,
+    // so that the reactor thread can go on watching the other helpers
+    void hand_off(std::unique_lock<std::mutex> &lock, bool may_block,
+                  std::function<void()> const &callbacks);
+    // Leave the helper to the reaper thread, optionally terminating it
+    // first, and report the given result instead of its own; the lock must
+    // be held, and the returned function must be passed to notify(). A job
+    // is only told to give up, and reports that result once it did.
+    std::function<void()> abandon(bool terminate, std::string const &out, int exit_code);
+    // Like expire_at(), with the lock held
+    void expire_locked(std::chrono::steady_clock::time_point deadline,
+                       std::string const &out, int exit_code);
+    // Arm the timerfd watched by the reactor thread for the next deadline,
+    // or disarm it if there is none
+    void arm_timer();
+    // Ask the X server whether the helper has a window yet, on a thread of
+    // its own; that thread kills the helper if not, so that retry() moves
+    // on. The lock must be held.
+    void check_watchdog();
+    // Spawn the helper command of the current attempt
+    bool spawn();
+    // Start a job on a thread of ours, in place of a helper
+    bool spawn_job(std::function<std::string(int)> const &job);
+    // Whether the helper that just exited failed to show its dialog at all
+    bool failed_to_start();
+    // Once the helper exited and its output was read, start the next helper
+    // if this one failed to show its dialog, and return true if we did
+    bool retry();
+
+    std::vector<std::vector<std::string>> m_commands;
+    std::vector<int_map<std::string>> m_answers;
+    std::vector<std::string> m_log;
+    // The last resort, once every command failed
+    std::function<std::string(int)> m_job;
+    size_t m_attempt = 0;
+    std::chrono::steady_clock::time_point m_spawned;
+
+    // This is 0 for a job started by start_job(), which has no process
+    pid_t m_pid = 0;
+    int m_fd = -1;
+    int m_pidfd = -1;
+    int m_eventfd = -1;
+    int m_timerfd = -1;
+    // An unlinked file holding what the helper wrote to stderr
+    int m_stderr = -1;
+    // A self-pipe that wakes up threads blocked in ready(), created by the
+    // first of them, so that they notice a new expiry deadline
+    int m_wakeup[2] = { -1, -1 };
+    // When to give up on the helper, and what to report then
+    std::chrono::steady_clock::time_point m_expiry = std::chrono::steady_clock::time_point::max();
+    std::string m_expiry_stdout;
+    int m_expiry_exit_code = -1;
+    // When to check that the helper came up, if at all, and whether it had
+    // not and was killed
+    bool m_use_watchdog = false;
+    std::chrono::steady_clock::time_point m_watchdog = std::chrono::steady_clock::time_point::max();
+    bool m_hung = false;
+    // Whether the job was told to give up, and has until the expiry
+    // deadline to hang up in turn
+    bool m_hanging_up = false;
+    bool m_eof = false;
+    // Whether the reactor thread does the work instead of ready()
+    std::atomic<bool> m_watched { false };
+    // Whether a thread was started to wait for the helper
+    bool m_waiter = false;
+#endif
+};
+
+#if __linux__
+// A single thread watching the helpers of all executors handed over to it,
+// using one epoll set for their stdout pipes and pidfds. It drains output,
+// reaps exited helpers and marks executors as done, so that waiting for a
+// dialog costs no syscall at all.
+class reactor
+{
+public:
+    static reactor &instance();
+
+    // Start watching all descriptors of an executor, or just one of them;
+    // false means that epoll could not take them, and none were added
+    bool add(executor *e);
+    bool add(executor *e, int fd);
+    void remove(int fd);
+    // Wait until the reactor thread is done with an executor that is about
+    // to be destroyed, unless called from that very thread
+    void forget(executor *e);
+
+private:
+    reactor();
+    void run();
+
+    int m_epoll;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    // The executor watching each descriptor, indexed by descriptor
+    std::vector<executor *> m_fds;
+    // The executor being updated, and the thread updating it
+    executor *m_current = nullptr;
+    std::thread::id m_thread;
+};
+#endif
+
+#if __linux__
+// Threads running the callbacks that may block, such as users’, for the
+// reactor thread. A callback may wait for another dialog whose callbacks
+// are queued behind it, so a new thread is started whenever all of them
+// are busy; otherwise an idle one is reused. Threads that stay idle for a
+// while exit.
+class dispatcher
+{
+public:
+    static dispatcher &instance();
+
+    void post(std::function<void()> const &task);
+
+private:
+    dispatcher() = default;
+    void run();
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::vector<std::function<void()>> m_tasks;
+    // Threads waiting for a task, and threads started but not waiting yet
+    size_t m_idle = 0;
+    size_t m_starting = 0;
+};
+#endif
+
+#if !_WIN32 && !__EMSCRIPTEN__ && !__NX__
+// A single thread reaping the helpers that no dialog waits for anymore, so
+// that they never linger as zombies, and killing those that were asked to
+// terminate but did not within the grace period.
+class reaper
+{
+public:
+    static reaper &instance();
+
+    // Take ownership of a helper and of its pidfd, if any; it is sent
+    // SIGKILL if it is still running at the deadline.
+    void adopt(pid_t pid, int pidfd, std::chrono::steady_clock::time_point deadline);
+
+private:
+    reaper();
+    void run();
+
+    struct child
+    {
+        pid_t pid;
+        int pidfd;
+        std::chrono::steady_clock::time_point deadline;
+        // Whether the helper may have exited
+        bool check;
+    };
+
+    int m_wakeup[2] = { -1, -1 };
+    std::mutex m_mutex;
+    // Wakes the thread up instead of the self-pipe, if it could not be made
+    std::condition_variable m_cond;
+    std::vector<child> m_children;
+};
+#endif
+
+#if !_WIN32 && !__APPLE__ && !__EMSCRIPTEN__ && !__NX__
+// Just enough of the X11 protocol to tell whether a helper came up, since
+// neither zenity nor kdialog tell us when their window is shown
+class x11
+{
+public:
+    // Whether the local X server named by DISPLAY certainly has no window
+    // from a process group, according to the window manager’s client list
+    // and _NET_WM_PID. Any doubt means false: on Wayland, with a remote
+    // display or a window manager that does not list its clients, if the
+    // server does not answer or let us in, or if a window belongs to a
+    // process that we cannot see, e.g. one in another PID namespace.
+    static bool lacks_window(pid_t pgid);
+
+private:
+    x11() = default;
+    ~x11();
+
+    // Send requests that all have a reply, and read these replies; those
+    // to failed requests are left empty
+    bool round_trip(std::vector<std::string> const &requests,
+                    std::vector<std::string> &replies);
+    bool read(char *buf, size_t len);
+
+    // The MIT-MAGIC-COOKIE-1 for a display number, from XAUTHORITY
+    static std::string cookie(std::string const &number);
+
+    int m_fd = -1;
+    std::chrono::steady_clock::time_point m_deadline;
+};
+#endif
+
+#if !_WIN32
+// Dialogs asked on the controlling terminal, for when there is no display
+// or no desktop helper, e.g. over SSH. They are meant to run as executor
+// jobs: each function returns the answer as a helper would have printed
+// it, and gives up as soon as the executor hangs up the socket.
+class tty
+{
+public:
+    enum class request
+    {
+        open_file,
+        save_file,
+        select_folder,
+    };
+
+    static std::string notify(std::string const &title, std::string const &message,
+                              icon _icon, int sock);
+    static button message(std::string const &title, std::string const &text,
+                          choice _choice, icon _icon, int sock);
+    static std::string file(request in_request, std::string const &title,
+                            std::string const &default_path,
+                            std::vector<std::string> const &filters,
+                            opt options, int sock);
+
+#if !__EMSCRIPTEN__ && !__NX__
+private:
+    // Wait for our turn on the terminal, and switch it to raw mode if asked
+    tty(int sock, bool raw);
+    ~tty();
+
+    void print(std::string const &str);
+    // Read a key, skipping escape sequences; -1 means the dialog is over
+    int key();
+    // Edit a line, with Tab completion of paths; false means cancelled
+    bool edit(std::string const &prompt, std::string &line,
+              std::vector<std::string> const &patterns, bool folders_only);
+    void complete(std::string &line, std::vector<std::string> const &patterns,
+                  bool folders_only);
+    bool confirm(std::string const &question);
+
+    static std::string prefix(icon _icon);
+    static std::string expand(std::string const &path);
+
+    // Dialogs take turns on the terminal, so there is a single set of saved
+    // terminal settings, also restored by atexit() if we exit during one
+    static std::mutex &mutex();
+    static struct termios &saved_attr();
+    static std::atomic<int> &raw_fd();
+    static void restore();
+
+    std::unique_lock<std::mutex> m_lock;
     int m_fd = -1;
+    int m_sock;
 #endif
 };
+#endif
 
 class platform
 {
@@ -216,14 +776,56 @@ protected:
 #endif
 };
 
+#if !_WIN32
+// A helper command line with a slot for what changes between dialogs built
+// from the same spec: the default path, or the text of a message
+struct command_template
+{
+    std::vector<std::string> args;
+    // The slot is at this offset in this argument, if there is one
+    size_t slot_arg = std::numeric_limits<size_t>::max();
+    size_t slot_offset = 0;
+    // Whether the value is quoted for osascript, and what comes before it;
+    // with a prefix, an empty value leaves the slot empty
+    bool osascript = false;
+    std::string prefix;
+};
+#endif
+
 class dialog : protected settings, protected platform
 {
+#if PFD_HAS_COROUTINES
+    template<typename T> friend class awaiter;
+#endif
+
 public:
     bool ready(int timeout = default_wait_timeout);
+    bool ready(std::chrono::steady_clock::time_point deadline);
+
+    // A file descriptor that becomes readable once the dialog is done, for
+    // use with poll() or an external event loop; ready() will then return
+    // true without blocking. This is -1 where unsupported (only Linux is).
+    int native_handle();
+
+    // Have pfd::poll_completed() report the given tag once the dialog is
+    // done; the tag is typically the dialog’s address or an id cast to it.
+    void track(void *tag);
+
+    // Close the dialog by terminating its helper; it then reports a cancel
+    // button or an empty selection. Not supported on Windows yet.
+    void cancel();
+
+    // Choose what happens to the helper if the dialog object, and all its
+    // copies, are destroyed before the dialog is closed
+    void on_drop(drop_policy policy);
 
 protected:
     explicit dialog();
 
+    bool is_osascript() const;
+    bool is_zenity() const;
+    bool is_kdialog() const;
+
     std::string desktop_helper() const;
     std::string buttons_to_name(choice _choice) const;
     std::string get_icon_name(icon _icon) const;
@@ -232,10 +834,56 @@ protected:
     std::string osascript_quote(std::string const &str) const;
     std::string shell_quote(std::string const &str) const;
 
-    bool check_program(std::string const &program);
+    // Run a callback with the helper’s output and exit code once the dialog
+    // is done, on a background thread or through a queue if one is given
+    void then(executor::callback const &cb, callback_queue *queue);
+
+    // Close the dialog after a timeout in milliseconds, reporting the given
+    // helper output and exit code instead of the user’s answer
+    void expire_after(int timeout, std::string const &out, int exit_code);
+
+#if !_WIN32
+    // Start the helper command built by a function. The command is also
+    // built for every other helper found, which the executor falls back to
+    // if the first one fails to start; in verbose mode, each command is
+    // logged when it is actually spawned. For helpers that only answer with
+    // their exit code, a second function gives the output matching each
+    // code, once the command is built. If a forced helper fails to start,
+    // scan the system for another one and rebuild. Without a display or a
+    // helper, the terminal job is run instead. If the watchdog is enabled,
+    // and unless the dialog may have no window, a helper that shows none in
+    // time is killed and replaced too.
+    void start_process(std::function<std::vector<std::string>()> const &build,
+                       std::function<int_map<std::string>()> const &answers,
+                       std::function<std::string(int)> const &tty_job,
+                       bool has_window = true);
+
+    // Put a value in the slot of a command template
+    std::vector<std::string> fill(command_template t, std::string const &value) const;
+#endif
+
+    // The scan result this dialog was built from, and the helper being
+    // considered, which is a copy of part of it
+    std::shared_ptr<scan_result const> m_scan_result;
+    scan_result const *m_scan;
 
     // Keep handle to executing command
     std::shared_ptr<executor> m_async;
+
+private:
+    // Shared by all copies of a dialog, so that only the last one to be
+    // destroyed applies the drop policy
+    class owner
+    {
+    public:
+        explicit owner(std::shared_ptr<executor> const &async) : m_async(async) {}
+        ~owner() { m_async->drop(m_policy); }
+
+        std::shared_ptr<executor> m_async;
+        drop_policy m_policy = drop_policy::block;
+    };
+
+    std::shared_ptr<owner> m_owner;
 };
 
 class file_dialog : public dialog
@@ -254,23 +902,90 @@ protected:
                 std::vector<std::string> filters = {},
                 opt options = opt::none);
 
+    file_dialog(type in_type,
+                file_dialog_spec const &spec,
+                std::string const &default_path);
+
+private:
+    // Start the dialog; the helper command is built from scratch, unless
+    // a spec is given, in which case it is only built once per helper
+    void init(type in_type,
+              std::string const &title,
+              std::string const &default_path,
+              std::vector<std::string> const &filters,
+              opt options,
+              file_dialog_spec const *spec);
+
 protected:
     std::string string_result();
     std::vector<std::string> vector_result();
 
+    // Decode the helper’s output
+    static std::string decode_string(std::string const &out);
+    static std::vector<std::string> decode_vector(std::string out);
+
+#if !_WIN32
+    // The command, with the default path left out
+    command_template helper_template(type in_type,
+                                     std::string const &title,
+                                     std::vector<std::string> const &filters,
+                                     opt options) const;
+
+    // The command for a given default path; with a spec, it is only built
+    // once per helper
+    std::vector<std::string> helper_command(type in_type,
+                                            std::string const &title,
+                                            std::string const &default_path,
+                                            std::vector<std::string> const &filters,
+                                            opt options,
+                                            file_dialog_spec const *spec) const;
+#endif
+
 #if _WIN32
     static int CALLBACK bffcallback(HWND hwnd, UINT uMsg, LPARAM, LPARAM pData);
     std::string select_folder_vista(IFileDialog *ifd, bool force_path);
 
     std::wstring m_wtitle;
     std::wstring m_wdefault_path;
-
-    std::vector<std::string> m_vector_result;
 #endif
 };
 
 } // namespace internal
 
+//
+// Dialog specs: what stays the same across many uses of a dialog, such as
+// an “Import asset” dialog opened over and over. The helper commands built
+// from a spec are cached in it, so that later dialogs only fill in what
+// varies. Copies of a spec share that cache, and can be used from any
+// thread.
+//
+
+class file_dialog_spec
+{
+public:
+    explicit file_dialog_spec(std::string const &title,
+                              std::vector<std::string> filters = internal::default_filters(),
+                              opt options = opt::none);
+
+private:
+    friend class internal::file_dialog;
+    struct data;
+    std::shared_ptr<data> m_data;
+};
+
+class message_spec
+{
+public:
+    explicit message_spec(std::string const &title,
+                          choice _choice = choice::ok_cancel,
+                          icon _icon = icon::info);
+
+private:
+    friend class message;
+    struct data;
+    std::shared_ptr<data> m_data;
+};
+
 //
 // The notify widget
 //
@@ -281,6 +996,13 @@ public:
     notify(std::string const &title,
            std::string const &message,
            icon _icon = icon::info);
+
+private:
+#if !_WIN32
+    std::vector<std::string> helper_command(std::string const &title,
+                                            std::string const &message,
+                                            icon _icon) const;
+#endif
 };
 
 //
@@ -295,11 +1017,55 @@ public:
             choice _choice = choice::ok_cancel,
             icon _icon = icon::info);
 
+    message(message_spec const &spec, std::string const &text);
+
     button result();
 
+    // Run a callback with the result once the dialog is closed: on a
+    // background thread, or on the thread running the queue if one is given
+    message &then(std::function<void(button)> const &callback,
+                  callback_queue *queue = nullptr);
+
+    // Close the dialog if the user did not answer within a timeout in
+    // milliseconds, and report a default button instead
+    message &timeout(int ms, button default_button = button::cancel);
+
+protected:
+#if !_WIN32
+    // The command for a given text, and how to map its exit codes; with a
+    // spec, it is only built once per helper
+    std::vector<std::string> helper_command(std::string const &title,
+                                            std::string const &text,
+                                            choice _choice,
+                                            icon _icon,
+                                            message_spec const *spec,
+                                            internal::int_map<button> &mappings) const;
+#endif
+
 private:
+    // Start the dialog; the helper command is built from scratch, unless
+    // a spec is given, in which case it is only built once per helper
+    void init(std::string const &title,
+              std::string const &text,
+              choice _choice,
+              icon _icon,
+              message_spec const *spec);
+
+    static button decode(std::string const &out, int exit_code,
+                         internal::int_map<button> const &mappings);
+    // The output that decode() understands as a given button
+    static std::string encode(button b);
+
+#if !_WIN32
+    // The command, with the text left out, and how to map its exit codes
+    internal::command_template helper_template(std::string const &title,
+                                     choice _choice,
+                                     icon _icon,
+                                     internal::int_map<button> &mappings) const;
+#endif
+
     // Some extra logic to map the exit code to button number
-    std::map<int, button> m_mappings;
+    internal::int_map<button> m_mappings;
 };
 
 //
@@ -311,9 +1077,12 @@ class open_file : public internal::file_dialog
 public:
     open_file(std::string const &title,
               std::string const &default_path = "",
-              std::vector<std::string> filters = { "All Files", "*" },
+              std::vector<std::string> filters = internal::default_filters(),
               opt options = opt::none);
 
+    open_file(file_dialog_spec const &spec,
+              std::string const &default_path = "");
+
 #if defined(__has_cpp_attribute)
 #if __has_cpp_attribute(deprecated)
     // Backwards compatibility
@@ -326,6 +1095,14 @@ public:
               bool allow_multiselect);
 
     std::vector<std::string> result();
+
+    // Run a callback with the result once the dialog is closed
+    open_file &then(std::function<void(std::vector<std::string>)> const &callback,
+                    callback_queue *queue = nullptr);
+
+    // Close the dialog if the user did not answer within a timeout in
+    // milliseconds, and report a default selection instead
+    open_file &timeout(int ms, std::vector<std::string> const &default_result = {});
 };
 
 class save_file : public internal::file_dialog
@@ -333,9 +1110,12 @@ class save_file : public internal::file_dialog
 public:
     save_file(std::string const &title,
               std::string const &default_path = "",
-              std::vector<std::string> filters = { "All Files", "*" },
+              std::vector<std::string> filters = internal::default_filters(),
               opt options = opt::none);
 
+    save_file(file_dialog_spec const &spec,
+              std::string const &default_path = "");
+
 #if defined(__has_cpp_attribute)
 #if __has_cpp_attribute(deprecated)
     // Backwards compatibility
@@ -348,6 +1128,14 @@ public:
               bool confirm_overwrite);
 
     std::string result();
+
+    // Run a callback with the result once the dialog is closed
+    save_file &then(std::function<void(std::string)> const &callback,
+                    callback_queue *queue = nullptr);
+
+    // Close the dialog if the user did not answer within a timeout in
+    // milliseconds, and report a default path instead
+    save_file &timeout(int ms, std::string const &default_result = "");
 };
 
 class select_folder : public internal::file_dialog
@@ -357,64 +1145,249 @@ public:
                   std::string const &default_path = "",
                   opt options = opt::none);
 
+    // The spec’s filters are not used
+    select_folder(file_dialog_spec const &spec,
+                  std::string const &default_path = "");
+
     std::string result();
+
+    // Run a callback with the result once the dialog is closed
+    select_folder &then(std::function<void(std::string)> const &callback,
+                        callback_queue *queue = nullptr);
+
+    // Close the dialog if the user did not answer within a timeout in
+    // milliseconds, and report a default path instead
+    select_folder &timeout(int ms, std::string const &default_result = "");
+};
+
+//
+// Waiting for several dialogs at once; on Linux this blocks in a single
+// poll() over all of them. A negative timeout means waiting forever.
+//
+
+// Return the index of a dialog that is done, or -1 on timeout
+int wait_any(std::vector<internal::dialog *> const &dialogs, int timeout = -1);
+int wait_any(std::vector<internal::dialog *> const &dialogs,
+             std::chrono::steady_clock::time_point deadline);
+
+// Return true once all dialogs are done, or false on timeout
+bool wait_all(std::vector<internal::dialog *> const &dialogs, int timeout = -1);
+bool wait_all(std::vector<internal::dialog *> const &dialogs,
+              std::chrono::steady_clock::time_point deadline);
+
+//
+// Polling for completed dialogs from a frame loop: this never blocks, and
+// costs a single atomic load when no tracked dialog completed. It returns
+// the tags given to dialog::track(), in completion order.
+//
+
+std::vector<void *> poll_completed();
+
+namespace internal
+{
+
+// A lock-free queue of tags, pushed by the threads that notice completions
+// and popped all at once by poll_completed()
+class completion_queue
+{
+public:
+    static completion_queue &instance();
+
+    void push(void *tag);
+    std::vector<void *> pop_all();
+
+private:
+    struct node
+    {
+        void *tag;
+        node *next;
+    };
+
+    std::atomic<node *> m_head { nullptr };
+};
+
+} // namespace internal
+
+#if PFD_HAS_COROUTINES
+//
+// Coroutine support: co_await on a dialog suspends the calling coroutine,
+// without blocking any thread, until the dialog is closed; it then returns
+// the dialog’s result. The coroutine is resumed on a thread started for it
+// by the reactor thread, or on a thread waiting for the helper where there
+// is no reactor.
+//
+
+namespace internal
+{
+
+template<typename T>
+class awaiter
+{
+public:
+    explicit awaiter(T &d) : m_dialog(d) {}
+
+    bool await_ready() { return m_dialog.ready(0); }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        static_cast<dialog &>(m_dialog).then([handle](std::string const &, int)
+        {
+            handle.resume();
+        }, nullptr);
+    }
+
+    // The dialog is done, so this does not block
+    auto await_resume() { return m_dialog.result(); }
+
+private:
+    T &m_dialog;
 };
 
+} // namespace internal
+
+template<typename T, typename U = typename std::remove_reference<T>::type,
+         typename = typename std::enable_if<std::is_base_of<internal::dialog, U>::value>::type>
+internal::awaiter<U> operator co_await(T &&d)
+{
+    return internal::awaiter<U>(d);
+}
+#endif
+
 //
 // Below this are all the method implementations. You may choose to define the
 // macro PFD_SKIP_IMPLEMENTATION everywhere before including this header except
-// in one place. This may reduce compilation times.
+// in one place. This may reduce compilation times. That one place must define
+// PFD_COMPILE_IMPLEMENTATION, so that the functions are compiled there as
+// regular functions rather than inline ones; the portable_file_dialogs_static
+// CMake target does exactly this.
 //
 
 #if !defined PFD_SKIP_IMPLEMENTATION
 
+#if defined PFD_COMPILE_IMPLEMENTATION
+#   define PFD_INLINE
+#else
+#   define PFD_INLINE inline
+#endif
+
 // settings implementation
 
-inline settings::settings(bool resync)
+PFD_INLINE settings::settings(bool resync)
 {
-    flags(flag::is_scanned) &= !resync;
+    if (resync)
+    {
+        // The next call to scan() will publish a new result. The current
+        // one is leaked, since scan() may be copying it without the lock;
+        // this only costs a few hundred bytes per rescan.
+        std::lock_guard<std::mutex> lock(scan_mutex());
+        current_scan().store(nullptr, std::memory_order_release);
+    }
 }
 
-inline void settings::verbose(bool value)
+PFD_INLINE void settings::verbose(bool value)
 {
-    settings().flags(flag::is_verbose) = value;
+    flags(flag::is_verbose) = value;
 }
 
-inline void settings::rescan()
+// Scan the system on a background thread so that the first dialog does not
+// have to. A dialog created while the scan is still running waits for it.
+PFD_INLINE void settings::prewarm()
 {
-    settings(true);
+    {
+        // If the mutex is busy, a scan is probably running already
+        std::unique_lock<std::mutex> lock(scan_mutex(), std::try_to_lock);
+        if (!lock.owns_lock() || current_scan().load(std::memory_order_acquire))
+            return;
+    }
+#if __EMSCRIPTEN__
+    scan();
+#else
+    std::thread([]() { scan(); }).detach();
+#endif
 }
 
-inline bool settings::is_osascript() const
+PFD_INLINE void settings::rescan()
 {
-#if __APPLE__
-    return true;
-#else
-    return false;
-#endif
+    settings(true);
+    prewarm();
 }
 
-inline bool settings::is_zenity() const
+PFD_INLINE void settings::backend(pfd::backend value, std::string const &helper_path /* = "" */)
 {
-    return flags(flag::has_zenity) ||
-           flags(flag::has_matedialog) ||
-           flags(flag::has_qarma);
+    {
+        std::lock_guard<std::mutex> lock(scan_mutex());
+        forced_backend() = std::make_pair(value, helper_path);
+        flags(flag::is_forced_broken) = false;
+    }
+    settings(true);
 }
 
-inline bool settings::is_kdialog() const
+PFD_INLINE void settings::reactor(bool value)
 {
-    return flags(flag::has_kdialog);
+    flags(flag::has_reactor) = value;
 }
 
-inline bool const &settings::flags(flag in_flag) const
+PFD_INLINE void settings::scan_cache(bool value)
 {
-    static bool flags[size_t(flag::max_flag)];
-    return flags[size_t(in_flag)];
+    flags(flag::no_scan_cache) = !value;
 }
 
-inline bool &settings::flags(flag in_flag)
+PFD_INLINE void settings::watchdog(bool value)
 {
-    return const_cast<bool &>(static_cast<const settings *>(this)->flags(in_flag));
+    flags(flag::use_watchdog) = value;
+}
+
+PFD_INLINE void settings::forced_failed()
+{
+    flags(flag::is_forced_broken) = true;
+    settings(true);
+}
+
+PFD_INLINE std::shared_ptr<settings::scan_result const> settings::scan()
+{
+    // Once the system was scanned, this and copying the result are the only
+    // cost of a scan() call
+    auto ret = current_scan().load(std::memory_order_acquire);
+    if (ret)
+        return *ret;
+
+    std::lock_guard<std::mutex> lock(scan_mutex());
+    ret = current_scan().load(std::memory_order_acquire);
+    if (!ret)
+    {
+        auto result = std::make_shared<scan_result>(scan_system());
+        // Displays come and go, so this is not part of the on-disk cache
+        result->has_display = probe_display();
+        ret = new std::shared_ptr<scan_result const>(result);
+        current_scan().store(ret, std::memory_order_release);
+    }
+    return *ret;
+}
+
+PFD_INLINE std::atomic<bool> &settings::flags(flag in_flag)
+{
+    static std::atomic<bool> flags[size_t(flag::max_flag)];
+    return flags[size_t(in_flag)];
+}
+
+PFD_INLINE std::atomic<std::shared_ptr<settings::scan_result const> const *> &settings::current_scan()
+{
+    static std::atomic<std::shared_ptr<scan_result const> const *> ret(nullptr);
+    return ret;
+}
+
+PFD_INLINE std::mutex &settings::scan_mutex()
+{
+    // Never destroyed, since a prewarm() thread may outlive main()
+    static auto ret = new std::mutex();
+    return *ret;
+}
+
+PFD_INLINE std::pair<pfd::backend, std::string> &settings::forced_backend()
+{
+    // Never destroyed, since a prewarm() thread may outlive main()
+    static auto ret = new std::pair<pfd::backend, std::string>(pfd::backend::automatic, "");
+    return *ret;
 }
 
 // internal free functions implementations
@@ -439,6 +1412,27 @@ static inline std::string wstr2str(std::wstring const &str)
     return ret;
 }
 
+// Windows wants patterns separated with semicolons instead of spaces
+static inline std::string filter_list(std::vector<std::string> const &f)
+{
+    std::string ret;
+    for (size_t i = 0; i + 1 < f.size(); i += 2)
+    {
+        ret += f[i] + '\0';
+        for (size_t j = 0; j < f[i + 1].size(); ++j)
+        {
+            char c = f[i + 1][j];
+            if (c != ' ')
+                ret += c;
+            else if (j == 0 || f[i + 1][j - 1] != ' ')
+                ret += ';';
+        }
+        ret += '\0';
+    }
+    ret += '\0';
+    return ret;
+}
+
 static inline bool is_vista()
 {
     OSVERSIONINFOEXW osvi;
@@ -458,6 +1452,21 @@ static inline bool is_vista()
 }
 #endif
 
+// Split a string along whitespace, skipping empty parts
+static inline std::vector<std::string> split(std::string const &str)
+{
+    std::vector<std::string> ret;
+    for (size_t i = 0; i < str.size(); )
+    {
+        auto start = str.find_first_not_of(" \t\n\v\f\r", i);
+        if (start == std::string::npos)
+            break;
+        i = (std::min)(str.find_first_of(" \t\n\v\f\r", start), str.size());
+        ret.push_back(str.substr(start, i - start));
+    }
+    return ret;
+}
+
 // This is necessary until C++20 which will have std::string::ends_with() etc.
 
 static inline bool ends_with(std::string const &str, std::string const &suffix)
@@ -472,247 +1481,2716 @@ static inline bool starts_with(std::string const &str, std::string const &prefix
         str.compare(0, prefix.size(), prefix) == 0;
 }
 
+#if !_WIN32 && !__EMSCRIPTEN__ && !__NX__
+// The environment passed to helper processes; on macOS, shared libraries
+// have no direct access to “environ”.
+static inline char **environment()
+{
+#if __APPLE__
+    return *_NSGetEnviron();
+#else
+    return environ;
+#endif
+}
+#endif
+
 } // namespace internal
 
-// executor implementation
+// settings scanning implementation
 
-inline std::string internal::executor::result(int *exit_code /* = nullptr */)
+PFD_INLINE settings::scan_result settings::scan_system()
 {
-    stop();
-    if (exit_code)
-        *exit_code = m_exit_code;
-    return m_stdout;
+    scan_result ret;
+#if _WIN32
+    flags(flag::is_vista) = internal::is_vista();
+#elif PFD_BACKEND == PFD_BACKEND_AUTO && !__APPLE__
+    // A forced helper needs no scan at all
+    if (!flags(flag::is_forced_broken) && scan_forced(ret))
+        return ret;
+
+    // Many short-lived processes may use us, so avoid repeating the scan
+    // when nothing that could change its outcome has changed.
+    auto key = scan_cache_key();
+    if (load_scan_cache(key, ret))
+        return ret;
+
+    // Remember the files that decided where each helper is, so that the
+    // cache is also stale once one of them is chmod’ed or replaced
+    std::string stamps;
+    static char const *const names[] = { "zenity", "matedialog", "qarma", "kdialog" };
+    for (size_t i = 0; i < size_t(helper::max_helper); ++i)
+    {
+        ret.path[i] = find_program(names[i], &stamps);
+        ret.enabled[i] = !ret.path[i].empty();
+    }
+
+    // If multiple helpers are available, try to default to the best one
+    bool &has_zenity = ret.enabled[size_t(helper::zenity)];
+    bool &has_kdialog = ret.enabled[size_t(helper::kdialog)];
+    if (has_zenity && has_kdialog)
+    {
+        auto desktop_name = std::getenv("XDG_SESSION_DESKTOP");
+        if (desktop_name && desktop_name == std::string("gnome"))
+            has_kdialog = false;
+        else if (desktop_name && desktop_name == std::string("KDE"))
+            has_zenity = false;
+    }
+
+    if (!key.empty())
+        save_scan_cache(key + stamps, ret);
+#endif
+    return ret;
 }
 
-#if _WIN32
-inline void internal::executor::start(std::function<std::string(int *)> const &fun)
+// Fill the scan result with the backend forced by backend() or, failing that,
+// by the PFD_BACKEND and PFD_HELPER_PATH environment variables. The helper is
+// not checked here: dialog::start_process() notices if it fails to start.
+PFD_INLINE bool settings::scan_forced(scan_result &result)
 {
-    stop();
-    m_future = std::async(fun, &m_exit_code);
-    m_running = true;
+    auto value = forced_backend().first;
+    auto path = forced_backend().second;
+
+    if (value == pfd::backend::automatic && path.empty())
+    {
+        auto env_backend = std::getenv("PFD_BACKEND");
+        auto env_path = std::getenv("PFD_HELPER_PATH");
+        std::string name = env_backend ? env_backend : "";
+        value = name == "zenity" ? pfd::backend::zenity
+              : name == "kdialog" ? pfd::backend::kdialog
+              : name == "tty" ? pfd::backend::tty
+              : pfd::backend::automatic;
+        path = env_path ? env_path : "";
+    }
+
+    // If only a helper was given, guess the backend from its name
+    if (value == pfd::backend::automatic && !path.empty())
+    {
+        auto name = path.substr(path.rfind('/') + 1);
+        if (name == "zenity" || name == "matedialog" || name == "qarma")
+            value = pfd::backend::zenity;
+        else if (name == "kdialog")
+            value = pfd::backend::kdialog;
+    }
+
+    if (value == pfd::backend::automatic)
+        return false;
+
+    result.is_forced = true;
+    if (value == pfd::backend::tty)
+    {
+        result.use_tty = true;
+        return true;
+    }
+
+    bool is_kdialog = value == pfd::backend::kdialog;
+    auto index = size_t(is_kdialog ? helper::kdialog : helper::zenity);
+    result.path[index] = !path.empty() ? path : is_kdialog ? "kdialog" : "zenity";
+    result.enabled[index] = true;
+    return true;
 }
-#endif
 
-#if __EMSCRIPTEN__
-inline void internal::executor::start(int exit_code)
+PFD_INLINE bool settings::probe_display()
 {
-    m_exit_code = exit_code;
+#if _WIN32 || __APPLE__ || __EMSCRIPTEN__ || __NX__
+    return true;
+#else
+    // A stale socket file is not enough: connecting tells whether a server
+    // is listening, without waiting for it. Linux X servers also listen on
+    // an abstract socket of the same name.
+    auto can_connect = [](std::string const &path, bool abstract) -> bool
+    {
+        struct sockaddr_un addr = {};
+        size_t offset = abstract ? 1 : 0;
+        if (path.size() + offset >= sizeof(addr.sun_path))
+            return false;
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path + offset, path.data(), path.size());
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1)
+            return false;
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        auto len = socklen_t(offsetof(struct sockaddr_un, sun_path) + offset + path.size());
+        bool ret = connect(fd, reinterpret_cast<struct sockaddr *>(&addr), len) == 0 || errno == EAGAIN;
+        close(fd);
+        return ret;
+    };
+
+    auto wayland = std::getenv("WAYLAND_DISPLAY");
+    if (wayland && *wayland)
+    {
+        // A relative socket name is looked up in XDG_RUNTIME_DIR
+        std::string path = wayland;
+        auto runtime_dir = std::getenv("XDG_RUNTIME_DIR");
+        if (path[0] != '/')
+            path = std::string(runtime_dir ? runtime_dir : "") + "/" + path;
+        if (can_connect(path, false))
+            return true;
+    }
+
+    auto x11 = std::getenv("DISPLAY");
+    if (x11 && *x11)
+    {
+        // Only local displays such as “:0.0” or “unix:0” can be checked
+        // without a network round trip; trust the others.
+        std::string name = x11;
+        if (name.compare(0, 5, "unix:") == 0)
+            name = name.substr(4);
+        if (name[0] != ':')
+            return true;
+
+        auto path = "/tmp/.X11-unix/X" + name.substr(1, name.find('.') - 1);
+#if __linux__
+        if (can_connect(path, true))
+            return true;
+#endif
+        return can_connect(path, false);
+    }
+
+    return false;
+#endif
 }
+
+// Split PATH into the list of directories to search for programs
+PFD_INLINE std::vector<std::string> settings::search_path()
+{
+    auto env_path = std::getenv("PATH");
+    std::string path = env_path ? env_path : "/usr/bin:/bin";
+
+    // Relative entries, including empty ones which mean the current
+    // directory, are resolved now so that helpers have absolute paths that
+    // still work after a chdir()
+    std::string cwd;
+#if !_WIN32 && !__EMSCRIPTEN__ && !__NX__
+    char buf[PATH_MAX];
+    if (getcwd(buf, sizeof(buf)))
+        cwd = buf;
 #endif
 
-inline void internal::executor::start(std::string const &command)
+    std::vector<std::string> ret;
+    for (size_t start = 0; start <= path.size(); )
+    {
+        auto end = path.find(':', start);
+        if (end == std::string::npos)
+            end = path.size();
+
+        auto dir = path.substr(start, end - start);
+        if (dir.empty() || dir[0] != '/')
+            dir = cwd.empty() ? "" : dir.empty() ? cwd : cwd + "/" + dir;
+        if (!dir.empty())
+            ret.push_back(dir);
+
+        start = end + 1;
+    }
+    return ret;
+}
+
+// Look for a program in PATH, the way “which” does, and return its absolute
+// path, or an empty string if it cannot be found. This is done in-process
+// because spawning “which” for each helper is noticeably slow.
+PFD_INLINE std::string settings::find_program(std::string const &program,
+                                          std::string *stamps /* = nullptr */)
 {
-    stop();
-    m_stdout.clear();
-    m_exit_code = -1;
+#if _WIN32 || __EMSCRIPTEN__ || __NX__
+    (void)program;
+    (void)stamps;
+    return "";
+#else
+    for (auto const &dir : search_path())
+    {
+        auto file = dir + "/" + program;
+
+        struct stat st;
+        if (stat(file.c_str(), &st) != 0)
+            continue;
+        if (stamps)
+            *stamps += "FILE " + file_stamp(file) + " " + file + "\n";
+        if (S_ISREG(st.st_mode) && access(file.c_str(), X_OK) == 0)
+            return file;
+    }
+    return "";
+#endif
+}
 
-#if _WIN32
-    STARTUPINFOW si;
-
-    memset(&si, 0, sizeof(si));
-    si.cb = sizeof(si);
-    si.dwFlags = STARTF_USESHOWWINDOW;
-    si.wShowWindow = SW_HIDE;
-
-    std::wstring wcommand = str2wstr(command);
-    if (!CreateProcessW(nullptr, (LPWSTR)wcommand.c_str(), nullptr, nullptr,
-                        FALSE, CREATE_NEW_CONSOLE, nullptr, nullptr, &si, &m_pi))
-        return; /* TODO: GetLastError()? */
-    WaitForInputIdle(m_pi.hProcess, INFINITE);
-#elif __EMSCRIPTEN__ || __NX__
-    // FIXME: do something
-    (void)command;
+PFD_INLINE std::string settings::file_stamp(std::string const &file)
+{
+#if _WIN32 || __APPLE__ || __EMSCRIPTEN__ || __NX__
+    (void)file;
+    return "";
 #else
-    m_stream = popen((command + " 2>/dev/null").c_str(), "r");
-    if (!m_stream)
-        return;
-    m_fd = fileno(m_stream);
-    fcntl(m_fd, F_SETFL, O_NONBLOCK);
+    struct stat st;
+    if (stat(file.c_str(), &st) != 0)
+        return "";
+    return std::to_string(st.st_mode) + " " + std::to_string(st.st_mtim.tv_sec) + "."
+                                            + std::to_string(st.st_mtim.tv_nsec);
 #endif
-    m_running = true;
 }
 
-inline internal::executor::~executor()
+// The directory where the scan cache lives, or an empty string if there is
+// no suitable location or if the cache is disabled.
+PFD_INLINE std::string settings::scan_cache_dir()
 {
-    stop();
+    auto env_cache = std::getenv("PFD_SCAN_CACHE");
+    if (flags(flag::no_scan_cache) || (env_cache && std::string(env_cache) == "0"))
+        return "";
+
+    auto cache_home = std::getenv("XDG_CACHE_HOME");
+    if (cache_home && cache_home[0] == '/')
+        return std::string(cache_home) + "/portable-file-dialogs";
+
+    auto home = std::getenv("HOME");
+    if (home && home[0] == '/')
+        return std::string(home) + "/.cache/portable-file-dialogs";
+
+    return "";
 }
 
-inline bool internal::executor::ready(int timeout /* = default_wait_timeout */)
+// Build the header of the scan cache file; the cache is only valid if it
+// starts with exactly this key. Any change to PATH, to the desktop session
+// or to the contents of a PATH directory (which updates its mtime) changes
+// the key. Returns an empty string if the scan cannot be cached.
+PFD_INLINE std::string settings::scan_cache_key()
 {
-    if (!m_running)
-        return true;
+#if _WIN32 || __APPLE__ || __EMSCRIPTEN__ || __NX__
+    return "";
+#else
+    auto env_path = std::getenv("PATH");
+    auto desktop_name = std::getenv("XDG_SESSION_DESKTOP");
+    std::string path = env_path ? env_path : "";
+    std::string desktop = desktop_name ? desktop_name : "";
 
-#if _WIN32
-    if (m_future.valid())
-    {
-        auto status = m_future.wait_for(std::chrono::milliseconds(timeout));
-        if (status != std::future_status::ready)
-            return false;
+    // A newline in either value would make the key ambiguous
+    if (path.find('\n') != std::string::npos || desktop.find('\n') != std::string::npos)
+        return "";
 
-        m_stdout = m_future.get();
-    }
-    else
+    std::string ret = "pfd scan cache 3\n";
+    ret += "PATH " + path + "\n";
+    ret += "DESKTOP " + desktop + "\n";
+
+    // Relative PATH entries depend on the current directory, so the key
+    // has the directories as they were resolved
+    for (auto const &dir : search_path())
     {
-        if (WaitForSingleObject(m_pi.hProcess, timeout) == WAIT_TIMEOUT)
-            return false;
+        if (dir.find('\n') != std::string::npos)
+            return "";
 
-        DWORD ret;
-        GetExitCodeProcess(m_pi.hProcess, &ret);
-        m_exit_code = (int)ret;
-        CloseHandle(m_pi.hThread);
-        CloseHandle(m_pi.hProcess);
+        struct stat st;
+        if (stat(dir.c_str(), &st) != 0)
+            ret += "DIR - " + dir + "\n";
+        else
+            ret += "DIR " + std::to_string(st.st_mtim.tv_sec) + "."
+                          + std::to_string(st.st_mtim.tv_nsec) + " " + dir + "\n";
     }
-#elif __EMSCRIPTEN__ || __NX__
-    // FIXME: do something
-    (void)timeout;
+    return ret;
+#endif
+}
+
+// Read the scan cache with a single mmap(); returns false if the cache is
+// missing, stale or malformed, in which case the result is left untouched.
+PFD_INLINE bool settings::load_scan_cache(std::string const &key, scan_result &result)
+{
+#if _WIN32 || __APPLE__ || __EMSCRIPTEN__ || __NX__
+    (void)key;
+    (void)result;
+    return false;
 #else
-    char buf[BUFSIZ];
-    ssize_t received = read(m_fd, buf, BUFSIZ - 1);
-    if (received == -1 && errno == EAGAIN)
-    {
-        // FIXME: this happens almost always at first iteration
-        std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+    auto dir = scan_cache_dir();
+    if (key.empty() || dir.empty())
+        return false;
+
+    int fd = open((dir + "/scan").c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
         return false;
+
+    bool ok = false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && size_t(st.st_size) > key.size())
+    {
+        size_t size = size_t(st.st_size);
+        void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            auto p = static_cast<char const *>(map), end = p + size;
+            if (memcmp(p, key.data(), key.size()) == 0)
+            {
+                // “FILE <mode> <mtime> <path>” lines follow the key, for the
+                // files the scan looked at, and must still be accurate
+                bool fresh = true;
+                for (p += key.size(); fresh && end - p > 5 && memcmp(p, "FILE ", 5) == 0; )
+                {
+                    auto eol = static_cast<char const *>(memchr(p, '\n', size_t(end - p)));
+                    if (!eol)
+                        break;
+                    std::string line(p + 5, eol);
+                    auto space = line.find(' ', line.find(' ') + 1);
+                    fresh = space != std::string::npos
+                         && file_stamp(line.substr(space + 1)) == line.substr(0, space);
+                    p = eol + 1;
+                }
+
+                // Then one “<enabled> <path>” line per helper
+                scan_result ret;
+                size_t i = 0;
+                for (; fresh && i < size_t(helper::max_helper) && p < end; ++i)
+                {
+                    auto eol = static_cast<char const *>(memchr(p, '\n', size_t(end - p)));
+                    if (!eol || eol - p < 2 || (p[0] != '0' && p[0] != '1') || p[1] != ' ')
+                        break;
+                    ret.enabled[i] = p[0] == '1';
+                    ret.path[i].assign(p + 2, eol);
+                    p = eol + 1;
+                }
+
+                ok = i == size_t(helper::max_helper) && p == end;
+                if (ok)
+                    result = ret;
+            }
+            munmap(map, size);
+        }
     }
-    if (received > 0)
+    close(fd);
+    return ok;
+#endif
+}
+
+// Write the scan cache, replacing any previous version atomically so that
+// concurrent readers never see a partial file.
+PFD_INLINE void settings::save_scan_cache(std::string const &key, scan_result const &result)
+{
+#if _WIN32 || __APPLE__ || __EMSCRIPTEN__ || __NX__
+    (void)key;
+    (void)result;
+#else
+    auto dir = scan_cache_dir();
+    if (key.empty() || dir.empty())
+        return;
+
+    std::string data = key;
+    for (size_t i = 0; i < size_t(helper::max_helper); ++i)
     {
-        m_stdout += std::string(buf, received);
-        return false;
+        if (result.path[i].find('\n') != std::string::npos)
+            return;
+        data += std::string(result.enabled[i] ? "1 " : "0 ") + result.path[i] + "\n";
     }
-    m_exit_code = pclose(m_stream);
+
+    // Create the cache directory, and its parent in case it is ~/.cache
+    mkdir(dir.substr(0, dir.rfind('/')).c_str(), 0700);
+    mkdir(dir.c_str(), 0700);
+
+    auto file = dir + "/scan";
+    auto tmp = file + "." + std::to_string(getpid());
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1)
+        return;
+
+    bool ok = write(fd, data.data(), data.size()) == ssize_t(data.size());
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), file.c_str()) != 0)
+        unlink(tmp.c_str());
 #endif
+}
 
-    m_running = false;
-    return true;
+// wait_any() and wait_all() implementation
+
+namespace internal
+{
+
+PFD_INLINE int timeout_until(std::chrono::steady_clock::time_point deadline)
+{
+    if (deadline == (std::chrono::steady_clock::time_point::max)())
+        return -1;
+
+    auto remaining = deadline - std::chrono::steady_clock::now();
+    if (remaining <= std::chrono::steady_clock::duration::zero())
+        return 0;
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                  remaining + std::chrono::milliseconds(1)
+                            - std::chrono::steady_clock::duration(1)).count();
+    return int((std::min<decltype(ms)>)(ms, (std::numeric_limits<int>::max)()));
 }
 
-inline void internal::executor::stop()
+// Turn a timeout in milliseconds into a deadline; negative means forever
+PFD_INLINE std::chrono::steady_clock::time_point deadline_after(int timeout)
 {
-    // Loop until the user closes the dialog
-    while (!ready())
+    if (timeout < 0)
+        return (std::chrono::steady_clock::time_point::max)();
+    return std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+}
+
+// Wait until any or all of the dialogs are done; return the index of a
+// dialog that is done, or -1 on timeout
+PFD_INLINE int wait_for(std::vector<dialog *> const &dialogs,
+                    std::chrono::steady_clock::time_point deadline, bool all)
+{
+    for (;;)
     {
-#if _WIN32
-        // On Windows, we need to run the message pump. If the async
-        // thread uses a Windows API dialog, it may be attached to the
-        // main thread and waiting for messages that only we can dispatch.
-        MSG msg;
-        while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+        int done = -1;
+        dialog *pending = nullptr;
+#if !_WIN32 && !__EMSCRIPTEN__ && !__NX__
+        std::vector<struct pollfd> fds;
+        bool pollable = true;
+#endif
+        for (size_t i = 0; i < dialogs.size(); ++i)
         {
-            TranslateMessage(&msg);
-            DispatchMessage(&msg);
+            // This costs no syscall once the dialog is watched by the reactor
+            if (dialogs[i]->ready(0))
+            {
+                if (!all)
+                    return int(i);
+                done = int(i);
+                continue;
+            }
+
+            pending = dialogs[i];
+#if !_WIN32 && !__EMSCRIPTEN__ && !__NX__
+            int fd = pollable ? dialogs[i]->native_handle() : -1;
+            if (fd == -1)
+                pollable = false;
+            else
+                fds.push_back({ fd, POLLIN, 0 });
+#endif
+        }
+
+        if (!pending)
+            return done;
+
+        auto now = std::chrono::steady_clock::now();
+        if (deadline <= now)
+            return -1;
+
+#if !_WIN32 && !__EMSCRIPTEN__ && !__NX__
+        if (pollable)
+        {
+            poll(fds.data(), nfds_t(fds.size()), timeout_until(deadline));
+            continue;
         }
 #endif
+        // Without pollable handles, wait on one dialog at a time for a
+        // short while, so that the others are checked regularly.
+        auto slice = now + std::chrono::milliseconds(default_wait_timeout);
+        pending->ready((std::min)(deadline, slice));
     }
 }
 
-// dll implementation
+} // namespace internal
 
-#if _WIN32
-inline internal::platform::dll::dll(std::string const &name)
-  : handle(::LoadLibraryA(name.c_str()))
-{}
+PFD_INLINE int wait_any(std::vector<internal::dialog *> const &dialogs, int timeout /* = -1 */)
+{
+    return wait_any(dialogs, internal::deadline_after(timeout));
+}
 
-inline internal::platform::dll::~dll()
+PFD_INLINE int wait_any(std::vector<internal::dialog *> const &dialogs,
+                    std::chrono::steady_clock::time_point deadline)
 {
-    if (handle)
-        ::FreeLibrary(handle);
+    return internal::wait_for(dialogs, deadline, false);
 }
-#endif // _WIN32
 
-// new_style_context implementation
+PFD_INLINE bool wait_all(std::vector<internal::dialog *> const &dialogs, int timeout /* = -1 */)
+{
+    return wait_all(dialogs, internal::deadline_after(timeout));
+}
 
-#if _WIN32
-inline internal::platform::new_style_context::new_style_context()
+PFD_INLINE bool wait_all(std::vector<internal::dialog *> const &dialogs,
+                     std::chrono::steady_clock::time_point deadline)
 {
-    // Only create one activation context for the whole app lifetime.
-    static HANDLE hctx = create();
+    return dialogs.empty() || internal::wait_for(dialogs, deadline, true) != -1;
+}
+
+// poll_completed() implementation
+
+PFD_INLINE std::vector<void *> poll_completed()
+{
+    return internal::completion_queue::instance().pop_all();
+}
+
+PFD_INLINE internal::completion_queue &internal::completion_queue::instance()
+{
+    // Never destroyed, since the reactor thread may push until the end
+    static completion_queue *ret = new completion_queue();
+    return *ret;
+}
+
+PFD_INLINE void internal::completion_queue::push(void *tag)
+{
+    node *n = new node { tag, m_head.load(std::memory_order_relaxed) };
+    while (!m_head.compare_exchange_weak(n->next, n, std::memory_order_release,
+                                         std::memory_order_relaxed))
+        ;
+}
+
+PFD_INLINE std::vector<void *> internal::completion_queue::pop_all()
+{
+    std::vector<void *> ret;
+
+    // Avoid taking the cache line for writing when there is nothing to pop
+    if (!m_head.load(std::memory_order_relaxed))
+        return ret;
+
+    // Nodes were pushed in reverse order
+    node *n = m_head.exchange(nullptr, std::memory_order_acquire);
+    for (node *p = n; p; p = p->next)
+        ret.push_back(p->tag);
+    std::reverse(ret.begin(), ret.end());
+
+    while (n)
+    {
+        node *next = n->next;
+        delete n;
+        n = next;
+    }
+    return ret;
+}
+
+// callback_queue implementation
+
+PFD_INLINE size_t callback_queue::run(int timeout /* = 0 */)
+{
+    std::vector<std::function<void()>> pending;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto has_pending = [this]() { return !m_pending.empty(); };
+        if (timeout < 0)
+            m_cond.wait(lock, has_pending);
+        else
+            m_cond.wait_for(lock, std::chrono::milliseconds(timeout), has_pending);
+        pending.swap(m_pending);
+    }
+
+    // Callbacks may post more callbacks, so do not hold the lock
+    for (auto const &callback : pending)
+        callback();
+    return pending.size();
+}
+
+PFD_INLINE void callback_queue::post(std::function<void()> const &callback)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending.push_back(callback);
+    m_cond.notify_all();
+}
+
+// executor implementation
+
+PFD_INLINE std::string internal::executor::result(int *exit_code /* = nullptr */)
+{
+    stop();
+    if (exit_code)
+        *exit_code = m_exit_code;
+    return m_stdout;
+}
+
+#if _WIN32
+PFD_INLINE void internal::executor::start(std::function<std::string(int *)> const &fun)
+{
+    stop();
+    m_done = false;
+
+    // The future becomes ready before the callbacks run, so that they may
+    // destroy their own dialog.
+    auto promise = std::make_shared<std::promise<std::string>>();
+    m_future = promise->get_future();
+    m_running = true;
+    std::thread([this, fun, promise]()
+    {
+        int exit_code = -1;
+        auto ret = fun(&exit_code);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stdout = ret;
+        m_exit_code = exit_code;
+        m_done = true;
+        auto callbacks = take_callbacks();
+        promise->set_value(ret);
+        notify(lock, callbacks);
+    }).detach();
+}
+#endif
+
+#if __EMSCRIPTEN__
+PFD_INLINE void internal::executor::start(int exit_code)
+{
+    m_exit_code = exit_code;
+}
+#endif
+
+#if !_WIN32
+PFD_INLINE bool internal::executor::start_process(std::vector<std::vector<std::string>> const &commands,
+                                              std::vector<int_map<std::string>> const &answers /* = {} */,
+                                              std::vector<std::string> const &log /* = {} */,
+                                              std::function<std::string(int)> const &job /* = nullptr */,
+                                              bool watchdog /* = false */,
+                                              bool job_if_unspawned /* = true */)
+{
+    stop();
+    m_stdout.clear();
+    m_exit_code = -1;
+#if !__EMSCRIPTEN__ && !__NX__
+    m_commands = commands;
+    m_answers = answers;
+    m_log = log;
+    m_job = job;
+    m_use_watchdog = watchdog;
+    m_hanging_up = false;
+    m_eof = false;
+    m_watched = false;
+    m_waiter = false;
+    m_expiry = std::chrono::steady_clock::time_point::max();
+    if (m_eventfd != -1)
+    {
+        close(m_eventfd);
+        m_eventfd = -1;
+    }
+
+    for (m_attempt = 0; m_attempt < m_commands.size(); ++m_attempt)
+    {
+        if (spawn())
+        {
+            m_running = true;
+            return true;
+        }
+    }
+
+    // No helper could even be spawned, so run the job right away
+    if (!job || !job_if_unspawned)
+        return false;
+    if (m_attempt < m_log.size())
+        fprintf(stderr, "pfd: %s\n", m_log[m_attempt].c_str());
+    m_job = nullptr;
+    if (!spawn_job(job))
+        return false;
+    m_running = true;
+    return true;
+#else
+    // FIXME: do something
+    (void)commands;
+    (void)answers;
+    (void)log;
+    (void)job;
+    (void)watchdog;
+    (void)job_if_unspawned;
+    m_running = true;
+    return true;
+#endif
+}
+
+PFD_INLINE bool internal::executor::start_job(std::function<std::string(int)> const &job)
+{
+    stop();
+    m_stdout.clear();
+    m_exit_code = -1;
+#if !__EMSCRIPTEN__ && !__NX__
+    m_commands.clear();
+    m_answers.clear();
+    m_log.clear();
+    m_job = nullptr;
+    m_attempt = 0;
+    m_hanging_up = false;
+    m_eof = false;
+    m_watched = false;
+    m_waiter = false;
+    m_expiry = std::chrono::steady_clock::time_point::max();
+    if (m_eventfd != -1)
+    {
+        close(m_eventfd);
+        m_eventfd = -1;
+    }
+
+    if (!spawn_job(job))
+        return false;
+
+    m_running = true;
+    return true;
+#else
+    // FIXME: do something
+    (void)job;
+    m_running = true;
+    return true;
+#endif
+}
+
+#if !__EMSCRIPTEN__ && !__NX__
+PFD_INLINE bool internal::executor::spawn_job(std::function<std::string(int)> const &job)
+{
+    // The job’s answer comes through a socket rather than a pipe, so that
+    // it can tell when we hang up, and write without risking SIGPIPE
+    int fds[2];
+#if __linux__
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0)
+        return false;
+#else
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+        return false;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#endif
+#if defined SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fds[1], SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+    m_pid = 0;
+    m_spawned = std::chrono::steady_clock::now();
+    m_watchdog = std::chrono::steady_clock::time_point::max();
+    m_fd = fds[0];
+    fcntl(m_fd, F_SETFL, O_NONBLOCK);
+
+    // The thread only owns its own end of the socket, so it may outlive us
+    int sock = fds[1];
+    std::thread([job, sock]()
+    {
+        auto out = job(sock);
+#if defined MSG_NOSIGNAL
+        int flags = MSG_NOSIGNAL;
+#else
+        int flags = 0;
+#endif
+        for (size_t sent = 0; sent < out.size(); )
+        {
+            ssize_t ret = send(sock, out.data() + sent, out.size() - sent, flags);
+            if (ret < 0 && errno == EINTR)
+                continue;
+            if (ret <= 0)
+                break;
+            sent += size_t(ret);
+        }
+        close(sock);
+    }).detach();
+
+    return true;
+}
+
+PFD_INLINE bool internal::executor::spawn()
+{
+    if (m_attempt < m_log.size())
+        fprintf(stderr, "pfd: %s\n", m_log[m_attempt].c_str());
+
+    std::vector<char *> argv;
+    for (auto const &arg : m_commands[m_attempt])
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    // Both ends of the pipe are close-on-exec; only the dup2()’ed copy of
+    // the write end survives in the child as its stdout.
+    int fds[2];
+#if __linux__
+    if (pipe2(fds, O_CLOEXEC) != 0)
+        return false;
+#else
+    if (pipe(fds) != 0)
+        return false;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#endif
+
+    // Unlike a pipe, a file never blocks the helper if we do not read it,
+    // and we only do if it exits at once
+#if __linux__ && defined SYS_memfd_create
+    m_stderr = int(syscall(SYS_memfd_create, "pfd-stderr", 1u /* MFD_CLOEXEC */));
+#else
+    char name[] = "/tmp/pfd-stderr-XXXXXX";
+    m_stderr = mkstemp(name);
+    if (m_stderr != -1)
+    {
+        unlink(name);
+        fcntl(m_stderr, F_SETFD, FD_CLOEXEC);
+    }
+#endif
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    if (m_stderr != -1)
+        posix_spawn_file_actions_adddup2(&actions, m_stderr, STDERR_FILENO);
+    else
+        posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    // Start the helper in a process group of its own, so that cancel() can
+    // terminate it along with anything it started itself.
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setpgroup(&attr, 0);
+    short flags = POSIX_SPAWN_SETPGROUP;
+
+    // Do not leak any other file descriptor of ours, even one that was
+    // opened without O_CLOEXEC, to the helper.
+#if __APPLE__
+    posix_spawn_file_actions_addinherit_np(&actions, STDIN_FILENO);
+    flags |= POSIX_SPAWN_CLOEXEC_DEFAULT;
+#elif defined __GLIBC__ && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 34))
+    posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1);
+#endif
+    posix_spawnattr_setflags(&attr, flags);
+
+    // Unlike fork(), posix_spawnp() does not copy our page tables, so its
+    // cost does not depend on the size of the calling process.
+    int ret = posix_spawnp(&m_pid, argv[0], &actions, &attr, argv.data(), environment());
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+
+    if (ret != 0)
+    {
+        close(fds[0]);
+        if (m_stderr != -1)
+            close(m_stderr);
+        m_stderr = -1;
+        return false;
+    }
+
+    m_spawned = std::chrono::steady_clock::now();
+    m_watchdog = m_use_watchdog ? m_spawned + std::chrono::milliseconds(helper_watchdog_time)
+                                : std::chrono::steady_clock::time_point::max();
+    m_hung = false;
+    m_fd = fds[0];
+    fcntl(m_fd, F_SETFL, O_NONBLOCK);
+
+#if __linux__ && defined SYS_pidfd_open
+    // A pidfd tells us exactly when the helper exits, even if it closed its
+    // stdout early or left it open to one of its own children.
+    m_pidfd = int(syscall(SYS_pidfd_open, m_pid, 0));
+#endif
+    return true;
+}
+#endif
+#endif
+
+PFD_INLINE internal::executor::~executor()
+{
+    stop();
+#if __linux__
+    if (m_watched)
+        reactor::instance().forget(this);
+#endif
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_notifying && m_notifier == std::this_thread::get_id())
+    {
+        // One of our callbacks is destroying us; tell notify() to stop
+        // touching us once it returns
+        *m_destroyed = true;
+    }
+    else
+    {
+        // Another thread may have just marked us as done; wait for it to
+        // run our callbacks and let go of the mutex.
+        m_cond.wait(lock, [this]() { return !m_notifying; });
+    }
+#if !_WIN32 && !__EMSCRIPTEN__ && !__NX__
+    for (int fd : { m_eventfd, m_wakeup[0], m_wakeup[1] })
+        if (fd != -1)
+            close(fd);
+#endif
+}
+
+PFD_INLINE bool internal::executor::ready(int timeout /* = default_wait_timeout */)
+{
+    if (!m_running)
+        return true;
+
+#if !_WIN32 && !__EMSCRIPTEN__ && !__NX__
+    // Polling a helper watched by the reactor thread is lock-free
+    if (timeout == 0 && m_watched)
+        return !m_running;
+#endif
+
+    return ready(deadline_after(timeout));
+}
+
+PFD_INLINE bool internal::executor::ready(std::chrono::steady_clock::time_point deadline)
+{
+    if (!m_running)
+        return true;
+
+    bool forever = deadline == (std::chrono::steady_clock::time_point::max)();
+
+#if _WIN32
+    if (forever)
+        m_future.wait();
+    else if (m_future.wait_until(deadline) != std::future_status::ready)
+        return false;
+
+    // The async task already stored the results
+    m_future.get();
+#elif __EMSCRIPTEN__ || __NX__
+    // FIXME: do something
+    (void)forever;
+#else
+    // Drain the pipe and block in poll() whenever it is empty, so that we
+    // wake up as soon as more data arrives or the helper exits, but never
+    // wait past the deadline. Without a pidfd, we can only learn about the
+    // exit from EOF, after which waitpid() is polled until the helper is
+    // gone, since blocking in it would ignore the deadline.
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        // Another thread may have finished the job while we were polling
+        if (!m_running)
+            return true;
+
+        // If the reactor thread is watching the helper, just wait for it
+        if (m_watched)
+        {
+            auto done = [this]() { return !m_running; };
+            if (forever)
+                m_cond.wait(lock, done);
+            else if (!m_cond.wait_until(lock, deadline, done))
+                return false;
+            return true;
+        }
+
+        if (!m_eof)
+            m_eof = drain();
+        if ((m_pidfd != -1 || m_eof) && reap(false))
+        {
+            // Whatever the helper wrote before exiting is still in the pipe
+            if (!m_eof)
+                drain();
+            if (!retry())
+                break;
+            continue;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now >= m_expiry)
+        {
+            // A job may take a little longer to hang up
+            if (!notify(lock, abandon(true, m_expiry_stdout, m_expiry_exit_code)))
+                return true;
+            continue;
+        }
+        if (now >= m_watchdog)
+        {
+            check_watchdog();
+            continue;
+        }
+        if (!forever && deadline <= now)
+            return false;
+
+        // expire_at() may move the deadline while we sleep
+        if (m_wakeup[0] == -1)
+        {
+#if __linux__
+            if (pipe2(m_wakeup, O_CLOEXEC | O_NONBLOCK) != 0)
+                m_wakeup[0] = m_wakeup[1] = -1;
+#else
+            if (pipe(m_wakeup) == 0)
+                for (int fd : m_wakeup)
+                {
+                    fcntl(fd, F_SETFD, FD_CLOEXEC);
+                    fcntl(fd, F_SETFL, O_NONBLOCK);
+                }
+            else
+                m_wakeup[0] = m_wakeup[1] = -1;
+#endif
+        }
+
+        struct pollfd fds[3];
+        nfds_t count = 0;
+        if (!m_eof)
+            fds[count++] = { m_fd, POLLIN, 0 };
+        if (m_pidfd != -1)
+            fds[count++] = { m_pidfd, POLLIN, 0 };
+        if (m_wakeup[0] != -1)
+            fds[count++] = { m_wakeup[0], POLLIN, 0 };
+
+        // Let other threads check on the helper while we sleep
+        auto wakeup = std::min(deadline, std::min(m_expiry, m_watchdog));
+        if (m_eof && m_pidfd == -1)
+            wakeup = std::min(wakeup, now + std::chrono::milliseconds(1));
+        lock.unlock();
+        poll(fds, count, timeout_until(wakeup));
+        lock.lock();
+
+        char buf[64];
+        while (m_wakeup[0] != -1 && read(m_wakeup[0], buf, sizeof(buf)) > 0)
+            ;
+    }
+
+    if (!notify(lock, finish()))
+        return true;
+#endif
+
+    m_running = false;
+    return true;
+}
+
+PFD_INLINE bool internal::executor::watch()
+{
+#if _WIN32 || __EMSCRIPTEN__ || __NX__
+    return false;
+#else
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return watch_locked();
+#endif
+}
+
+PFD_INLINE int internal::executor::native_handle()
+{
+#if __linux__
+    // Only the reactor thread can signal completion without anyone calling
+    // ready(), so the helper has to be handed over to it.
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_eventfd == -1)
+    {
+        if (!watch_locked() && m_running)
+            return -1;
+        m_eventfd = eventfd(m_running ? 0 : 1, EFD_CLOEXEC | EFD_NONBLOCK);
+    }
+    return m_eventfd;
+#else
+    return -1;
+#endif
+}
+
+PFD_INLINE void internal::executor::then(callback const &cb, bool may_block /* = true */)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+#if _WIN32
+    (void)may_block;
+    if (m_running && !m_done)
+    {
+        m_callbacks.push_back(cb);
+        return;
+    }
+#elif !__EMSCRIPTEN__ && !__NX__
+    if (m_running)
+    {
+        m_callbacks.push_back(cb);
+        m_may_block = m_may_block || may_block;
+
+        // Without the reactor thread, someone has to wait for the helper;
+        // that thread keeps us alive for as long as it needs us.
+        if (!watch_locked() && !m_waiter)
+        {
+            m_waiter = true;
+            auto self = shared_from_this();
+            std::thread([self]() { self->ready(-1); }).detach();
+        }
+        return;
+    }
+#endif
+    lock.unlock();
+    cb(m_stdout, m_exit_code);
+}
+
+PFD_INLINE void internal::executor::settle()
+{
+    stop();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_notifying || m_notifier != std::this_thread::get_id())
+        m_cond.wait(lock, [this]() { return !m_notifying; });
+}
+
+PFD_INLINE void internal::executor::cancel()
+{
+#if !_WIN32 && !__EMSCRIPTEN__ && !__NX__
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_running)
+        notify(lock, abandon(true, "", -1));
+#endif
+}
+
+PFD_INLINE void internal::executor::drop(drop_policy policy)
+{
+#if !_WIN32 && !__EMSCRIPTEN__ && !__NX__
+    if (policy != drop_policy::block)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_running)
+            notify(lock, abandon(policy == drop_policy::kill, "", -1));
+    }
+#else
+    // FIXME: the Windows dialog threads use the dialog object itself, so
+    // they cannot outlive it yet
+    (void)policy;
+#endif
+
+    // Even if a waiter thread keeps us alive, wait for the dialog to be
+    // closed and for its callbacks to have run
+    settle();
+}
+
+PFD_INLINE void internal::executor::expire_at(std::chrono::steady_clock::time_point deadline,
+                                          std::string const &out, int exit_code)
+{
+#if !_WIN32 && !__EMSCRIPTEN__ && !__NX__
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_running && !m_hanging_up)
+        expire_locked(deadline, out, exit_code);
+#else
+    // FIXME: the Windows dialog threads cannot be interrupted yet
+    (void)deadline;
+    (void)out;
+    (void)exit_code;
+#endif
+}
+
+#if !_WIN32 && !__EMSCRIPTEN__ && !__NX__
+PFD_INLINE void internal::executor::expire_locked(std::chrono::steady_clock::time_point deadline,
+                                              std::string const &out, int exit_code)
+{
+    m_expiry = deadline;
+    m_expiry_stdout = out;
+    m_expiry_exit_code = exit_code;
+
+    // The reactor thread enforces the deadline with a timer. Otherwise, wake
+    // up any thread blocked in ready() so that it polls until the deadline.
+#if __linux__
+    if (m_watched)
+    {
+        bool is_new = m_timerfd == -1;
+        arm_timer();
+        if (m_timerfd == -1 || (is_new && !reactor::instance().add(this, m_timerfd)))
+        {
+            // Without a timer, a thread of ours has to enforce the deadline
+            auto self = shared_from_this();
+            std::thread([self]()
+            {
+                std::unique_lock<std::mutex> thread_lock(self->m_mutex);
+                auto done = [&self]() { return !self->m_running; };
+                while (!self->m_cond.wait_until(thread_lock, self->m_expiry, done))
+                    if (std::chrono::steady_clock::now() >= self->m_expiry)
+                        self->notify(thread_lock, self->abandon(true, self->m_expiry_stdout,
+                                                                self->m_expiry_exit_code));
+            }).detach();
+        }
+        return;
+    }
+    if (watch_locked())
+        return;
+#endif
+    if (m_wakeup[1] != -1)
+    {
+        char c = 0;
+        ssize_t ret = write(m_wakeup[1], &c, 1);
+        (void)ret;
+    }
+}
+#endif
+
+PFD_INLINE bool internal::executor::notify(std::unique_lock<std::mutex> &lock,
+                                       std::function<void()> const &callbacks)
+{
+    if (!callbacks)
+        return true;
+
+    bool destroyed = false;
+    m_notifying = true;
+    m_notifier = std::this_thread::get_id();
+    m_destroyed = &destroyed;
+    lock.unlock();
+    callbacks();
+    if (destroyed)
+        return false;
+
+    lock.lock();
+    m_notifying = false;
+    m_destroyed = nullptr;
+    m_cond.notify_all();
+    return true;
+}
+
+PFD_INLINE std::function<void()> internal::executor::take_callbacks()
+{
+    if (m_callbacks.empty())
+        return nullptr;
+
+    std::vector<callback> callbacks;
+    callbacks.swap(m_callbacks);
+    m_may_block = false;
+    auto out = m_stdout;
+    auto exit_code = m_exit_code;
+    return [callbacks, out, exit_code]()
+    {
+        for (auto const &cb : callbacks)
+            cb(out, exit_code);
+    };
+}
+
+#if !_WIN32 && !__EMSCRIPTEN__ && !__NX__
+PFD_INLINE bool internal::executor::drain()
+{
+    for (;;)
+    {
+        char buf[BUFSIZ];
+        ssize_t received = read(m_fd, buf, BUFSIZ);
+        if (received > 0)
+            m_stdout.append(buf, size_t(received));
+        else if (received == 0 || (errno != EAGAIN && errno != EINTR))
+            return true;
+        else if (errno == EAGAIN)
+            return false;
+    }
+}
+
+PFD_INLINE bool internal::executor::reap(bool block)
+{
+    // A job is over when it hangs up, and it only answers with its output
+    if (m_pid == 0)
+    {
+        m_exit_code = m_stdout.empty() ? -1 : 0;
+        return m_eof;
+    }
+
+    int status = -1;
+    pid_t ret;
+    while ((ret = waitpid(m_pid, &status, block ? 0 : WNOHANG)) == -1 && errno == EINTR)
+        ;
+    if (ret == 0)
+        return false;
+
+    // Like pclose(), report the raw wait status of the helper
+    m_exit_code = ret == m_pid ? status : -1;
+    return true;
+}
+
+PFD_INLINE bool internal::executor::watch_locked()
+{
+#if __linux__
+    if (!m_watched && m_running && (m_pidfd != -1 || m_pid == 0))
+    {
+        arm_timer();
+        m_watched = reactor::instance().add(this);
+    }
+#endif
+    return m_watched;
+}
+
+PFD_INLINE void internal::executor::arm_timer()
+{
+#if __linux__
+    // Setting the timer also clears its readability, so a disarmed timer
+    // does not keep waking up the reactor thread
+    auto deadline = std::min(m_expiry, m_watchdog);
+    struct itimerspec spec = {};
+    if (deadline == std::chrono::steady_clock::time_point::max())
+    {
+        if (m_timerfd != -1)
+            timerfd_settime(m_timerfd, 0, &spec, nullptr);
+        return;
+    }
+
+    // steady_clock is CLOCK_MONOTONIC, so its deadlines can be used as is
+    if (m_timerfd == -1)
+        m_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (m_timerfd == -1)
+        return;
+
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+    spec.it_value.tv_sec = time_t(ns / 1000000000);
+    spec.it_value.tv_nsec = long(ns % 1000000000);
+    // A zero it_value would disarm the timer instead
+    if (ns <= 0)
+        spec.it_value.tv_nsec = 1;
+    timerfd_settime(m_timerfd, TFD_TIMER_ABSTIME, &spec, nullptr);
+#endif
+}
+
+PFD_INLINE std::function<void()> internal::executor::finish()
+{
+    for (int *fd : { &m_fd, &m_pidfd, &m_timerfd })
+    {
+        if (*fd == -1)
+            continue;
+#if __linux__
+        if (m_watched)
+            reactor::instance().remove(*fd);
+#endif
+        close(*fd);
+        *fd = -1;
+    }
+    if (m_stderr != -1)
+        close(m_stderr);
+    m_stderr = -1;
+
+    // Whatever a job that was told to give up wrote is not an answer
+    if (m_hanging_up)
+    {
+        m_stdout = m_expiry_stdout;
+        m_exit_code = m_expiry_exit_code;
+    }
+
+    // Some helpers only answer with their exit code
+    if (m_stdout.empty() && m_attempt < m_answers.size())
+    {
+        auto it = m_answers[m_attempt].find(m_exit_code);
+        if (it != m_answers[m_attempt].end())
+            m_stdout = it->second;
+    }
+
+    m_running = false;
+    m_cond.notify_all();
+#if __linux__
+    if (m_eventfd != -1)
+        eventfd_write(m_eventfd, 1);
+#endif
+    return take_callbacks();
+}
+
+PFD_INLINE void internal::executor::update()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_running)
+        return;
+
+    // Stop watching the pipe at EOF, since it would stay readable forever
+    if (!m_eof && (m_eof = drain()))
+    {
+        reactor::instance().remove(m_fd);
+        close(m_fd);
+        m_fd = -1;
+    }
+
+    bool may_block = m_may_block;
+    if (reap(false))
+    {
+        if (!m_eof)
+            drain();
+        if (!retry())
+            hand_off(lock, may_block, finish());
+    }
+    else if (std::chrono::steady_clock::now() >= m_expiry)
+    {
+        hand_off(lock, may_block, abandon(true, m_expiry_stdout, m_expiry_exit_code));
+    }
+    else if (std::chrono::steady_clock::now() >= m_watchdog)
+    {
+        // We learn about the kill through the pidfd
+        check_watchdog();
+        arm_timer();
+    }
+}
+
+PFD_INLINE void internal::executor::check_watchdog()
+{
+    m_watchdog = std::chrono::steady_clock::time_point::max();
+#if !__APPLE__
+    if (m_pid == 0 || !m_stdout.empty())
+        return;
+
+    // Asking the X server takes a few round trips, or up to a second if it
+    // does not answer, during which neither ready() nor the reactor thread
+    // may wait. Whoever watches the helper learns about the kill as usual.
+    std::weak_ptr<executor> weak = shared_from_this();
+    pid_t pid = m_pid;
+    size_t attempt = m_attempt;
+    std::thread([weak, pid, attempt]()
+    {
+        bool hung = x11::lacks_window(pid);
+        auto self = weak.lock();
+        if (!hung || !self)
+            return;
+
+        // Unless that helper is gone already
+        std::lock_guard<std::mutex> lock(self->m_mutex);
+        if (self->m_running && self->m_pid == pid && self->m_attempt == attempt
+             && self->m_stdout.empty())
+        {
+            self->m_hung = true;
+            kill(-pid, SIGKILL);
+        }
+    }).detach();
+#endif
+}
+
+PFD_INLINE void internal::executor::hand_off(std::unique_lock<std::mutex> &lock, bool may_block,
+                                         std::function<void()> const &callbacks)
+{
+    if (!may_block || !callbacks)
+    {
+        notify(lock, callbacks);
+        return;
+    }
+
+    // Until a thread runs the callbacks, our destructor and settle() wait
+    // for it as if we were running them ourselves
+    m_notifying = true;
+    m_notifier = std::thread::id();
+    dispatcher::instance().post([this, callbacks]()
+    {
+        std::unique_lock<std::mutex> thread_lock(m_mutex);
+        notify(thread_lock, callbacks);
+    });
+}
+
+PFD_INLINE bool internal::executor::failed_to_start()
+{
+    if (m_hung)
+        return true;
+
+    // Nobody answers a dialog that quickly, so a helper that exits this early
+    // without printing anything either crashed, or could not show its dialog,
+    // which it then complains about. A user who cancels at once gets the
+    // same exit status as the latter, but no complaint. An exit code of -1
+    // means that the helper could not be reaped, not that it failed.
+    if (!m_stdout.empty() || m_exit_code == -1
+         || std::chrono::steady_clock::now() - m_spawned >= std::chrono::milliseconds(helper_startup_time))
+        return false;
+    if (WIFSIGNALED(m_exit_code))
+        return true;
+    if (!WIFEXITED(m_exit_code) || WEXITSTATUS(m_exit_code) == 0 || m_stderr == -1)
+        return false;
+
+    // E.g. “cannot open display”, or Qt’s “could not connect to display”
+    // followed by “no Qt platform plugin could be initialized”
+    char buf[4096];
+    ssize_t len = pread(m_stderr, buf, sizeof(buf), 0);
+    std::string err(buf, size_t(std::max(len, ssize_t(0))));
+    std::transform(err.begin(), err.end(), err.begin(), [](char c) { return char(tolower(c)); });
+    return err.find("display") != std::string::npos
+        || err.find("platform plugin") != std::string::npos;
+}
+
+PFD_INLINE bool internal::executor::retry()
+{
+    // Without the reactor, this is only noticed if someone is waiting for
+    // the dialog
+    if (m_pid == 0 || (m_attempt + 1 >= m_commands.size() && !m_job) || !failed_to_start())
+        return false;
+
+    if (m_stderr != -1)
+        close(m_stderr);
+    m_stderr = -1;
+    for (int *fd : { &m_fd, &m_pidfd })
+    {
+        if (*fd == -1)
+            continue;
+#if __linux__
+        if (m_watched)
+            reactor::instance().remove(*fd);
+#endif
+        close(*fd);
+        *fd = -1;
+    }
+
+    // Try the next helpers, in order of preference
+    m_eof = false;
+    while (++m_attempt < m_commands.size())
+    {
+        if (spawn())
+        {
+            m_exit_code = -1;
+#if __linux__
+            if (!m_watched)
+                return true;
+
+            // The timer, if any, is still being watched
+            bool is_new = m_timerfd == -1;
+            arm_timer();
+            if (!reactor::instance().add(this, m_fd) || !reactor::instance().add(this, m_pidfd))
+            {
+                // Nobody would notice this helper exit, so give up on it
+                reactor::instance().remove(m_fd);
+                close(m_fd);
+                m_fd = -1;
+                kill(-m_pid, SIGTERM);
+                reaper::instance().adopt(m_pid, m_pidfd, deadline_after(kill_grace_period));
+                m_pidfd = -1;
+                return false;
+            }
+            if (is_new && m_timerfd != -1 && !reactor::instance().add(this, m_timerfd))
+            {
+                // Then the watchdog just does not run
+                close(m_timerfd);
+                m_timerfd = -1;
+            }
+#endif
+            return true;
+        }
+    }
+
+    // Every helper failed, so ask on the terminal as a last resort
+    if (m_attempt < m_log.size())
+        fprintf(stderr, "pfd: %s\n", m_log[m_attempt].c_str());
+    auto job = m_job;
+    m_job = nullptr;
+    if (!job || !spawn_job(job))
+        return false;
+    m_exit_code = -1;
+#if __linux__
+    if (m_watched)
+        arm_timer();
+    if (m_watched && !reactor::instance().add(this, m_fd))
+    {
+        // The job gives up once we hang up
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+#endif
+    return true;
+}
+
+PFD_INLINE std::function<void()> internal::executor::abandon(bool terminate,
+                                                        std::string const &out,
+                                                        int exit_code)
+{
+    // A job is told to give up whatever the policy, since nobody could read
+    // its answer anyway. It may be using the terminal, so it is only done
+    // once it hangs up in turn, or after a grace period; whoever watches it
+    // finishes it then, as with an expiry, without anyone blocking here.
+    if (m_pid == 0 && m_fd != -1 && !m_eof && !m_hanging_up)
+    {
+        shutdown(m_fd, SHUT_WR);
+        m_hanging_up = true;
+        expire_locked(deadline_after(kill_grace_period), out, exit_code);
+        return nullptr;
+    }
+    if (m_pid != 0)
+    {
+        // The helper leads its own process group, which also holds any
+        // process it started itself
+        if (terminate)
+            kill(-m_pid, SIGTERM);
+
+        // From now on the reaper thread owns the helper and its pidfd
+#if __linux__
+        if (m_pidfd != -1 && m_watched)
+            reactor::instance().remove(m_pidfd);
+#endif
+        reaper::instance().adopt(m_pid, m_pidfd, terminate
+            ? deadline_after(kill_grace_period)
+            : std::chrono::steady_clock::time_point::max());
+        m_pidfd = -1;
+    }
+
+    // Whatever the helper wrote so far is not an answer
+    m_stdout = out;
+    m_exit_code = exit_code;
+    return finish();
+}
+#endif
+
+// reactor implementation
+
+#if __linux__
+PFD_INLINE internal::reactor &internal::reactor::instance()
+{
+    // Never destroyed, since its thread runs until the program exits
+    static reactor *ret = new reactor();
+    return *ret;
+}
+
+PFD_INLINE internal::reactor::reactor()
+  : m_epoll(epoll_create1(EPOLL_CLOEXEC))
+{
+    if (m_epoll == -1)
+        return;
+    std::thread thread(&reactor::run, this);
+    m_thread = thread.get_id();
+    thread.detach();
+}
+
+// Start watching the descriptors of an executor, whose lock must be held
+PFD_INLINE bool internal::reactor::add(executor *e)
+{
+    int const fds[] = { e->m_fd, e->m_pidfd, e->m_timerfd };
+    for (size_t i = 0; i < 3; ++i)
+    {
+        if (add(e, fds[i]))
+            continue;
+        while (i--)
+            if (fds[i] != -1)
+                remove(fds[i]);
+        return false;
+    }
+    return true;
+}
+
+PFD_INLINE bool internal::reactor::add(executor *e, int fd)
+{
+    if (m_epoll == -1)
+        return false;
+    if (fd == -1)
+        return true;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) != 0)
+        return false;
+    if (size_t(fd) >= m_fds.size())
+        m_fds.resize(size_t(fd) + 1);
+    m_fds[size_t(fd)] = e;
+    return true;
+}
+
+// Stop watching a descriptor; must be called before closing it
+PFD_INLINE void internal::reactor::remove(int fd)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+    if (size_t(fd) < m_fds.size())
+        m_fds[size_t(fd)] = nullptr;
+}
+
+PFD_INLINE void internal::reactor::forget(executor *e)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (std::this_thread::get_id() != m_thread)
+        m_cond.wait(lock, [this, e]() { return m_current != e; });
+}
+
+PFD_INLINE void internal::reactor::run()
+{
+    for (;;)
+    {
+        struct epoll_event events[32];
+        int count = epoll_wait(m_epoll, events, 32, -1);
+        for (int i = 0; i < count; ++i)
+        {
+            // The executor may have been unregistered by a previous event of
+            // this batch, and its descriptor number reused by another one;
+            // this is harmless, since update() never blocks.
+            std::unique_lock<std::mutex> lock(m_mutex);
+            auto fd = size_t(events[i].data.fd);
+            if (fd >= m_fds.size() || !m_fds[fd])
+                continue;
+
+            // Another thread may cancel the executor and destroy it while
+            // we update it; its destructor waits for us through forget().
+            executor *e = m_current = m_fds[fd];
+            lock.unlock();
+            e->update();
+            lock.lock();
+            m_current = nullptr;
+            m_cond.notify_all();
+        }
+    }
+}
+#endif
+
+// dispatcher implementation
+
+#if __linux__
+PFD_INLINE internal::dispatcher &internal::dispatcher::instance()
+{
+    // Never destroyed, since its threads may outlive main()
+    static dispatcher *ret = new dispatcher();
+    return *ret;
+}
+
+PFD_INLINE void internal::dispatcher::post(std::function<void()> const &task)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tasks.push_back(task);
+    if (m_tasks.size() <= m_idle + m_starting)
+    {
+        m_cond.notify_one();
+        return;
+    }
+    ++m_starting;
+    std::thread(&dispatcher::run, this).detach();
+}
+
+PFD_INLINE void internal::dispatcher::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    --m_starting;
+    for (;;)
+    {
+        ++m_idle;
+        bool has_task = m_cond.wait_for(lock, std::chrono::seconds(10),
+                                        [this]() { return !m_tasks.empty(); });
+        --m_idle;
+        if (!has_task)
+            return;
+
+        auto task = m_tasks.front();
+        m_tasks.erase(m_tasks.begin());
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
+#endif
+
+// reaper implementation
+
+#if !_WIN32 && !__EMSCRIPTEN__ && !__NX__
+PFD_INLINE internal::reaper &internal::reaper::instance()
+{
+    // Never destroyed, since its thread runs until the program exits
+    static reaper *ret = new reaper();
+    return *ret;
+}
+
+PFD_INLINE internal::reaper::reaper()
+{
+    // A self-pipe wakes the thread up when a helper is adopted; without
+    // one, the thread polls for new helpers instead
+#if __linux__
+    if (pipe2(m_wakeup, O_CLOEXEC | O_NONBLOCK) != 0)
+        m_wakeup[0] = m_wakeup[1] = -1;
+#else
+    if (pipe(m_wakeup) != 0)
+        m_wakeup[0] = m_wakeup[1] = -1;
+    for (int fd : m_wakeup)
+    {
+        if (fd == -1)
+            continue;
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+    }
+#endif
+    std::thread(&reaper::run, this).detach();
+}
+
+PFD_INLINE void internal::reaper::adopt(pid_t pid, int pidfd,
+                                    std::chrono::steady_clock::time_point deadline)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_children.push_back({ pid, pidfd, deadline, true });
+    if (m_wakeup[1] != -1)
+    {
+        char c = 0;
+        ssize_t ret = write(m_wakeup[1], &c, 1);
+        (void)ret;
+    }
+    else
+    {
+        m_cond.notify_all();
+    }
+}
+
+PFD_INLINE void internal::reaper::run()
+{
+    std::vector<struct pollfd> fds;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        // Without a self-pipe, sleep until there is a helper, and then only
+        // as long as it takes to notice the next one; poll() ignores the
+        // negative descriptor.
+        if (m_wakeup[0] == -1)
+            m_cond.wait(lock, [this]() { return !m_children.empty(); });
+
+        auto now = std::chrono::steady_clock::now();
+        auto deadline = std::chrono::steady_clock::time_point::max();
+        if (m_wakeup[0] == -1)
+            deadline = now + std::chrono::milliseconds(default_wait_timeout);
+        fds.assign(1, { m_wakeup[0], POLLIN, 0 });
+
+        for (auto it = m_children.begin(); it != m_children.end(); )
+        {
+            // Only new helpers, helpers whose pidfd is readable and helpers
+            // without a pidfd may have exited
+            if (it->check || it->pidfd == -1)
+            {
+                int status;
+                pid_t ret;
+                while ((ret = waitpid(it->pid, &status, WNOHANG)) == -1 && errno == EINTR)
+                    ;
+                if (ret != 0)
+                {
+                    if (it->pidfd != -1)
+                        close(it->pidfd);
+                    it = m_children.erase(it);
+                    continue;
+                }
+            }
+
+            // Only a child that was not reaped yet can be killed safely,
+            // since its pid cannot have been reused
+            if (it->deadline <= now)
+            {
+                kill(-it->pid, SIGKILL);
+                it->deadline = std::chrono::steady_clock::time_point::max();
+            }
+
+            deadline = std::min(deadline, it->deadline);
+            if (it->pidfd != -1)
+                fds.push_back({ it->pidfd, POLLIN, 0 });
+            else
+                deadline = std::min(deadline, now + std::chrono::milliseconds(default_wait_timeout));
+            ++it;
+        }
+
+        lock.unlock();
+        poll(fds.data(), nfds_t(fds.size()), timeout_until(deadline));
+        char buf[64];
+        while (m_wakeup[0] != -1 && read(m_wakeup[0], buf, sizeof(buf)) > 0)
+            ;
+        lock.lock();
+
+        // Only this thread removes children, and adopt() appends them, so
+        // the ones we polled are still in the same order
+        size_t i = 1;
+        for (auto &c : m_children)
+            if (c.pidfd != -1 && i < fds.size())
+                c.check = fds[i++].revents != 0;
+    }
+}
+#endif
+
+// x11 implementation
+
+#if !_WIN32 && !__APPLE__ && !__EMSCRIPTEN__ && !__NX__
+PFD_INLINE internal::x11::~x11()
+{
+    if (m_fd != -1)
+        close(m_fd);
+}
+
+PFD_INLINE bool internal::x11::lacks_window(pid_t pgid)
+{
+    // Helpers use Wayland when they can, and a remote display is not worth
+    // the round trips, so only a local X server is asked
+    auto wayland = std::getenv("WAYLAND_DISPLAY");
+    auto display = std::getenv("DISPLAY");
+    if ((wayland && *wayland) || !display)
+        return false;
+    std::string name = display;
+    if (name.compare(0, 5, "unix:") == 0)
+        name = name.substr(4);
+    if (name.empty() || name[0] != ':')
+        return false;
+    auto number = name.substr(1, name.find('.') - 1);
+
+    struct sockaddr_un addr = {};
+    auto path = "/tmp/.X11-unix/X" + number;
+    if (path.size() >= sizeof(addr.sun_path))
+        return false;
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.data(), path.size());
+
+    x11 x;
+    x.m_deadline = deadline_after(1000);
+    x.m_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (x.m_fd == -1)
+        return false;
+    fcntl(x.m_fd, F_SETFD, FD_CLOEXEC);
+    fcntl(x.m_fd, F_SETFL, O_NONBLOCK);
+#if defined SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(x.m_fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    if (::connect(x.m_fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0)
+        return false;
+
+    // Everything is sent and decoded in little-endian order
+    auto put = [](std::string &str, unsigned long val, size_t bytes)
+    {
+        for (size_t i = 0; i < bytes; ++i)
+            str += char((val >> (8 * i)) & 0xff);
+    };
+    auto get = [](std::string const &str, size_t offset, size_t bytes)
+    {
+        unsigned long val = 0;
+        for (size_t i = 0; i < bytes && offset + i < str.size(); ++i)
+            val |= (unsigned long)(unsigned char)str[offset + i] << (8 * i);
+        return val;
+    };
+    auto pad = [](std::string &str) { str.append((4 - str.size() % 4) % 4, '\0'); };
+    auto get_property = [&put](unsigned long window, unsigned long property, unsigned long type)
+    {
+        std::string req;
+        put(req, 20, 1);
+        put(req, 0, 1);
+        put(req, 6, 2);
+        for (unsigned long arg : { window, property, type, 0ul, 4096ul })
+            put(req, arg, 4);
+        return req;
+    };
+    auto intern_atom = [&](std::string const &atom)
+    {
+        std::string req;
+        put(req, 16, 1);
+        put(req, 1 /* only if exists */, 1);
+        put(req, 2 + (atom.size() + 3) / 4, 2);
+        put(req, atom.size(), 2);
+        put(req, 0, 2);
+        req += atom;
+        pad(req);
+        return req;
+    };
+    enum { atom_cardinal = 6, atom_window = 33 };
+
+    auto auth = cookie(number);
+    std::string setup;
+    put(setup, 'l', 1);
+    put(setup, 0, 1);
+    put(setup, 11, 2);
+    put(setup, 0, 2);
+    put(setup, auth.empty() ? 0 : 18, 2);
+    put(setup, auth.size(), 2);
+    put(setup, 0, 2);
+    if (!auth.empty())
+    {
+        setup += "MIT-MAGIC-COOKIE-1";
+        pad(setup);
+        setup += auth;
+        pad(setup);
+    }
+
+    char header[8];
+#if defined MSG_NOSIGNAL
+    int flags = MSG_NOSIGNAL;
+#else
+    int flags = 0;
+#endif
+    if (send(x.m_fd, setup.data(), setup.size(), flags) != ssize_t(setup.size())
+         || !x.read(header, sizeof(header)) || header[0] != 1)
+        return false;
+    std::string info(header, sizeof(header));
+    info.resize(sizeof(header) + 4 * get(info, 6, 2));
+    if (!x.read(&info[sizeof(header)], info.size() - sizeof(header)))
+        return false;
+
+    // Skip the vendor string and the pixmap formats to the first screen
+    size_t offset = 40 + (get(info, 24, 2) + 3) / 4 * 4 + 8 * get(info, 29, 1);
+    auto root = get(info, offset, 4);
+    if (offset + 4 > info.size())
+        return false;
+
+    // Without a client list, top-level windows could be anywhere in the
+    // tree, depending on the window manager
+    std::vector<std::string> replies;
+    if (!x.round_trip({ intern_atom("_NET_WM_PID"), intern_atom("_NET_CLIENT_LIST") }, replies))
+        return false;
+    auto wm_pid = get(replies[0], 8, 4);
+    auto client_list = get(replies[1], 8, 4);
+    if (!wm_pid || !client_list
+         || !x.round_trip({ get_property(root, client_list, atom_window) }, replies)
+         || get(replies[0], 1, 1) != 32)
+        return false;
+
+    std::vector<std::string> requests;
+    for (size_t i = 0; i < get(replies[0], 16, 4); ++i)
+        requests.push_back(get_property(get(replies[0], 32 + 4 * i, 4), wm_pid, atom_cardinal));
+    if (!x.round_trip(requests, replies))
+        return false;
+
+    // The window may belong to any process of the helper’s group, e.g. if
+    // the helper is a wrapper script
+    for (auto const &reply : replies)
+    {
+        if (get(reply, 1, 1) != 32 || get(reply, 16, 4) != 1)
+            return false;
+        auto owner = pid_t(get(reply, 32, 4));
+        pid_t group = owner > 0 ? getpgid(owner) : -1;
+        if (group == -1 || group == pgid)
+            return false;
+    }
+    return true;
+}
+
+PFD_INLINE bool internal::x11::round_trip(std::vector<std::string> const &requests,
+                                      std::vector<std::string> &replies)
+{
+    std::string buf;
+    for (auto const &req : requests)
+        buf += req;
+#if defined MSG_NOSIGNAL
+    int flags = MSG_NOSIGNAL;
+#else
+    int flags = 0;
+#endif
+    for (size_t sent = 0; sent < buf.size(); )
+    {
+        ssize_t ret = send(m_fd, buf.data() + sent, buf.size() - sent, flags);
+        if (ret < 0 && (errno == EAGAIN || errno == EINTR))
+        {
+            struct pollfd fd = { m_fd, POLLOUT, 0 };
+            if (errno == EAGAIN && poll(&fd, 1, timeout_until(m_deadline)) <= 0)
+                return false;
+            continue;
+        }
+        if (ret <= 0)
+            return false;
+        sent += size_t(ret);
+    }
+
+    // Each request gets either a reply or an error, in order; we asked for
+    // no events, but skip any anyway
+    replies.assign(requests.size(), std::string());
+    for (size_t i = 0; i < requests.size(); )
+    {
+        char head[32];
+        if (!read(head, sizeof(head)))
+            return false;
+        if (head[0] == 0)
+        {
+            ++i;
+            continue;
+        }
+        if (head[0] != 1)
+            continue;
+
+        auto extra = size_t((unsigned char)head[4]) | size_t((unsigned char)head[5]) << 8
+                   | size_t((unsigned char)head[6]) << 16 | size_t((unsigned char)head[7]) << 24;
+        if (extra > (1 << 20))
+            return false;
+        auto &reply = replies[i++];
+        reply.assign(head, sizeof(head));
+        reply.resize(sizeof(head) + 4 * extra);
+        if (!read(&reply[sizeof(head)], 4 * extra))
+            return false;
+    }
+    return true;
+}
+
+PFD_INLINE bool internal::x11::read(char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t ret = ::read(m_fd, buf, len);
+        if (ret < 0 && (errno == EAGAIN || errno == EINTR))
+        {
+            struct pollfd fd = { m_fd, POLLIN, 0 };
+            if (errno == EAGAIN && poll(&fd, 1, timeout_until(m_deadline)) <= 0)
+                return false;
+            continue;
+        }
+        if (ret <= 0)
+            return false;
+        buf += ret;
+        len -= size_t(ret);
+    }
+    return true;
+}
+
+PFD_INLINE std::string internal::x11::cookie(std::string const &number)
+{
+    std::string file;
+    auto xauthority = std::getenv("XAUTHORITY");
+    auto home = std::getenv("HOME");
+    if (xauthority && *xauthority)
+        file = xauthority;
+    else if (home)
+        file = std::string(home) + "/.Xauthority";
+    else
+        return "";
+
+    char hostname[256] = {};
+    gethostname(hostname, sizeof(hostname) - 1);
+
+    // Entries are a family, then an address, a display number, an
+    // authorization name and its data, each with a big-endian length
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return "";
+    std::string data;
+    char buf[4096];
+    for (ssize_t len; data.size() < (1 << 20) && (len = ::read(fd, buf, sizeof(buf))) > 0; )
+        data.append(buf, size_t(len));
+    close(fd);
+
+    for (size_t offset = 0; offset + 2 <= data.size(); )
+    {
+        auto family = size_t((unsigned char)data[offset]) << 8 | (unsigned char)data[offset + 1];
+        offset += 2;
+        std::string fields[4];
+        for (auto &field : fields)
+        {
+            if (offset + 2 > data.size())
+                return "";
+            auto len = size_t((unsigned char)data[offset]) << 8 | (unsigned char)data[offset + 1];
+            if (offset + 2 + len > data.size())
+                return "";
+            field = data.substr(offset + 2, len);
+            offset += 2 + len;
+        }
+
+        // FamilyLocal entries name our host, and FamilyWild ones any host
+        if ((family == 256 && fields[0] == hostname) || family == 65535)
+            if ((fields[1].empty() || fields[1] == number) && fields[2] == "MIT-MAGIC-COOKIE-1")
+                return fields[3];
+    }
+    return "";
+}
+#endif
+
+// tty implementation
+
+#if !_WIN32
+PFD_INLINE std::string internal::tty::notify(std::string const &title, std::string const &message,
+                                         icon _icon, int sock)
+{
+#if __EMSCRIPTEN__ || __NX__
+    (void)title; (void)message; (void)_icon; (void)sock;
+#else
+    tty t(sock, false);
+    t.print(prefix(_icon) + title + ": " + message + "\n");
+#endif
+    return "";
+}
+
+PFD_INLINE button internal::tty::message(std::string const &title, std::string const &text,
+                                     choice _choice, icon _icon, int sock)
+{
+#if __EMSCRIPTEN__ || __NX__
+    (void)title; (void)text; (void)_choice; (void)_icon; (void)sock;
+    return button::cancel;
+#else
+    std::vector<std::pair<std::string, button>> buttons;
+    switch (_choice)
+    {
+        case choice::ok_cancel: buttons = { { "OK", button::ok }, { "Cancel", button::cancel } }; break;
+        case choice::yes_no: buttons = { { "Yes", button::yes }, { "No", button::no } }; break;
+        case choice::yes_no_cancel: buttons = { { "Yes", button::yes }, { "No", button::no }, { "Cancel", button::cancel } }; break;
+        case choice::retry_cancel: buttons = { { "Retry", button::retry }, { "Cancel", button::cancel } }; break;
+        case choice::abort_retry_ignore: buttons = { { "Abort", button::abort }, { "Retry", button::retry }, { "Ignore", button::ignore } }; break;
+        /* case choice::ok: */ default: buttons = { { "OK", button::ok } }; break;
+    }
+
+    tty t(sock, true);
+    if (t.m_fd == -1)
+        return button::cancel;
+
+    // Each button is chosen with its initial; Enter picks the first one
+    std::string prompt;
+    for (auto const &b : buttons)
+        prompt += "[" + b.first.substr(0, 1) + "]" + b.first.substr(1) + " ";
+    t.print("\n" + prefix(_icon) + title + "\n\n" + text + "\n\n" + prompt);
+
+    for (;;)
+    {
+        int c = t.key();
+        if (c == -1 || c == 3 || c == 27)
+        {
+            t.print("\n");
+            return button::cancel;
+        }
+        for (auto const &b : buttons)
+        {
+            if (c == '\n' || tolower(c) == tolower(b.first[0]))
+            {
+                t.print(b.first + "\n");
+                return b.second;
+            }
+        }
+    }
+#endif
+}
+
+PFD_INLINE std::string internal::tty::file(request in_request, std::string const &title,
+                                       std::string const &default_path,
+                                       std::vector<std::string> const &filters,
+                                       opt options, int sock)
+{
+#if __EMSCRIPTEN__ || __NX__
+    (void)in_request; (void)title; (void)default_path; (void)filters; (void)options; (void)sock;
+    return "";
+#else
+    // Filters come in pairs of a name and a space-separated pattern list
+    std::vector<std::string> patterns;
+    for (size_t i = 1; i < filters.size(); i += 2)
+        for (auto const &pat : split(filters[i]))
+            patterns.push_back(pat);
+
+    tty t(sock, true);
+    if (t.m_fd == -1)
+        return "";
+
+    bool is_folder = in_request == request::select_folder;
+    bool is_multi = in_request == request::open_file && (options & opt::multiselect);
+
+    struct stat st;
+    auto line = default_path;
+    if (!line.empty() && line.back() != '/' && stat(expand(line).c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+        line += '/';
+
+    t.print("\n" + title + "\n" + (is_multi ? "One file per line, then an empty line.\n" : ""));
+
+    std::string ret;
+    for (;;)
+    {
+        if (!t.edit("> ", line, patterns, is_folder))
+            return "";
+        if (line.empty())
+        {
+            if (is_multi)
+                return ret;
+            continue;
+        }
+
+        // Report absolute paths, like the desktop helpers do
+        auto path = expand(line);
+        if (path[0] != '/')
+        {
+            char cwd[PATH_MAX];
+            if (getcwd(cwd, sizeof(cwd)))
+                path = std::string(cwd) + (cwd[1] ? "/" : "") + path;
+        }
+        while (path.size() > 1 && path.back() == '/')
+            path.pop_back();
+
+        bool exists = stat(path.c_str(), &st) == 0;
+        bool is_dir = exists && S_ISDIR(st.st_mode);
+        auto parent = path.substr(0, std::max(path.rfind('/'), size_t(1)));
+
+        std::string error;
+        if (is_folder && !is_dir)
+            error = "No such folder";
+        else if (!is_folder && is_dir)
+            error = "This is a folder";
+        else if (in_request == request::open_file && !exists)
+            error = "No such file";
+        else if (in_request == request::save_file && (stat(parent.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)))
+            error = "No such folder: " + parent;
+        else if (in_request == request::save_file && exists && !(options & opt::force_overwrite)
+                  && !t.confirm("Replace it? [y/N] "))
+            continue;
+
+        if (!error.empty())
+        {
+            t.print(error + "\n");
+            continue;
+        }
+
+        ret += path + "\n";
+        if (!is_multi)
+            return ret;
+        line.clear();
+    }
+#endif
+}
+
+#if !__EMSCRIPTEN__ && !__NX__
+PFD_INLINE internal::tty::tty(int sock, bool raw)
+  : m_lock(mutex(), std::defer_lock),
+    m_sock(sock)
+{
+    // Give up waiting for our turn if the dialog is cancelled meanwhile
+    while (!m_lock.try_lock())
+    {
+        struct pollfd fd = { m_sock, POLLIN, 0 };
+        if (poll(&fd, 1, default_wait_timeout) > 0)
+            return;
+    }
+
+    m_fd = open("/dev/tty", O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (m_fd == -1 || !raw)
+        return;
+
+    if (tcgetattr(m_fd, &saved_attr()) != 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+        return;
+    }
+
+    static int registered = atexit(restore);
+    (void)registered;
+
+    // Read keys one at a time, without echo, and handle Ctrl-C ourselves.
+    // Typeahead is discarded, so that it cannot answer the dialog.
+    struct termios attr = saved_attr();
+    attr.c_lflag &= ~tcflag_t(ICANON | ECHO | ISIG | IEXTEN);
+    attr.c_cc[VMIN] = 1;
+    attr.c_cc[VTIME] = 0;
+    raw_fd() = m_fd;
+    tcsetattr(m_fd, TCSAFLUSH, &attr);
+}
+
+PFD_INLINE internal::tty::~tty()
+{
+    if (raw_fd() == m_fd)
+        restore();
+    if (m_fd != -1)
+        close(m_fd);
+}
+
+PFD_INLINE void internal::tty::print(std::string const &str)
+{
+    for (size_t done = 0; done < str.size(); )
+    {
+        ssize_t ret = write(m_fd, str.data() + done, str.size() - done);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            return;
+        done += size_t(ret);
+    }
+}
+
+PFD_INLINE int internal::tty::key()
+{
+    for (;;)
+    {
+        // Whatever wakes us up on the socket means the executor hung up
+        struct pollfd fds[2] = { { m_fd, POLLIN, 0 }, { m_sock, POLLIN, 0 } };
+        if (poll(fds, 2, -1) < 0 && errno != EINTR)
+            return -1;
+        if (fds[1].revents)
+            return -1;
+        if (!fds[0].revents)
+            continue;
+
+        unsigned char c;
+        ssize_t ret = read(m_fd, &c, 1);
+        if (ret < 0 && (errno == EINTR || errno == EAGAIN))
+            continue;
+        if (ret <= 0)
+            return -1;
+        if (c != 27)
+            return c;
+
+        // A lone Esc is a key; the escape sequences of arrows and function
+        // keys arrive all at once, and end with a byte in @…~
+        struct pollfd fd = { m_fd, POLLIN, 0 };
+        if (poll(&fd, 1, default_wait_timeout) <= 0)
+            return c;
+        if (read(m_fd, &c, 1) == 1 && (c == '[' || c == 'O'))
+            while (read(m_fd, &c, 1) == 1 && (c < '@' || c > '~'))
+                ;
+    }
+}
+
+PFD_INLINE bool internal::tty::edit(std::string const &prompt, std::string &line,
+                                std::vector<std::string> const &patterns, bool folders_only)
+{
+    for (;;)
+    {
+        print("\r\x1b[K" + prompt + line);
+        int c = key();
+        switch (c)
+        {
+            case -1: case 3 /* Ctrl-C */: case 27 /* Esc */:
+                print("\n");
+                return false;
+            case 4 /* Ctrl-D */:
+                if (!line.empty())
+                    break;
+                print("\n");
+                return false;
+            case '\n': case '\r':
+                print("\n");
+                return true;
+            case '\t':
+                complete(line, patterns, folders_only);
+                break;
+            case 21 /* Ctrl-U */:
+                line.clear();
+                break;
+            case 8 /* Ctrl-H */: case 127 /* Backspace */:
+                // Erase a whole UTF-8 sequence
+                while (!line.empty() && (line.back() & 0xc0) == 0x80)
+                    line.pop_back();
+                if (!line.empty())
+                    line.pop_back();
+                break;
+            default:
+                if (c >= ' ')
+                    line += char(c);
+                break;
+        }
+    }
+}
+
+PFD_INLINE void internal::tty::complete(std::string &line, std::vector<std::string> const &patterns,
+                                    bool folders_only)
+{
+    // Complete the last component of the path, in its directory
+    auto slash = line.rfind('/');
+    auto dir = expand(slash == std::string::npos ? "." : line.substr(0, slash + 1));
+    auto start = line.substr(slash == std::string::npos ? 0 : slash + 1);
+
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return;
+
+    std::vector<std::string> matches;
+    while (struct dirent *entry = readdir(d))
+    {
+        std::string name = entry->d_name;
+        if (name == "." || name == ".." || !starts_with(name, start)
+             || (name[0] == '.' && start.empty()))
+            continue;
+
+        struct stat st;
+        if (stat((dir + "/" + name).c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+            name += '/';
+        else if (folders_only || (!patterns.empty() &&
+                     std::none_of(patterns.begin(), patterns.end(), [&name](std::string const &p)
+                     {
+                         return fnmatch(p.c_str(), name.c_str(), 0) == 0;
+                     })))
+            continue;
+        matches.push_back(name);
+    }
+    closedir(d);
+
+    if (matches.empty())
+        return;
+
+    // Add what all matches have in common; if that is nothing, list them
+    auto common = matches[0];
+    for (auto const &name : matches)
+    {
+        size_t n = 0;
+        while (n < common.size() && n < name.size() && common[n] == name[n])
+            ++n;
+        common.resize(n);
+    }
+
+    if (common.size() > start.size())
+        line += common.substr(start.size());
+    else if (matches.size() > 1)
+    {
+        std::sort(matches.begin(), matches.end());
+        std::string list = "\n";
+        for (auto const &name : matches)
+            list += name + "  ";
+        print(list + "\n");
+    }
+}
+
+PFD_INLINE bool internal::tty::confirm(std::string const &question)
+{
+    print(question);
+    bool ret = tolower(key()) == 'y';
+    print(ret ? "yes\n" : "no\n");
+    return ret;
+}
+
+PFD_INLINE std::string internal::tty::prefix(icon _icon)
+{
+    switch (_icon)
+    {
+        case icon::warning: return "Warning: ";
+        case icon::error: return "Error: ";
+        default: return "";
+    }
+}
+
+PFD_INLINE std::string internal::tty::expand(std::string const &path)
+{
+    auto home = std::getenv("HOME");
+    if (home && (path == "~" || starts_with(path, "~/")))
+        return home + path.substr(1);
+    return path;
+}
+
+PFD_INLINE std::mutex &internal::tty::mutex()
+{
+    static std::mutex ret;
+    return ret;
+}
+
+PFD_INLINE struct termios &internal::tty::saved_attr()
+{
+    static struct termios ret;
+    return ret;
+}
+
+PFD_INLINE std::atomic<int> &internal::tty::raw_fd()
+{
+    static std::atomic<int> ret(-1);
+    return ret;
+}
+
+PFD_INLINE void internal::tty::restore()
+{
+    int fd = raw_fd().exchange(-1);
+    if (fd != -1)
+        tcsetattr(fd, TCSAFLUSH, &saved_attr());
+}
+#endif
+#endif
+
+PFD_INLINE void internal::executor::stop()
+{
+#if !_WIN32
+    // Block until the user closes the dialog and the helper exits
+    while (!ready(-1))
+        ;
+#else
+    // Loop until the user closes the dialog
+    while (!ready())
+    {
+        // On Windows, we need to run the message pump. If the async
+        // thread uses a Windows API dialog, it may be attached to the
+        // main thread and waiting for messages that only we can dispatch.
+        MSG msg;
+        while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+        {
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
+    }
+#endif
+}
+
+// dll implementation
+
+#if _WIN32
+PFD_INLINE internal::platform::dll::dll(std::string const &name)
+  : handle(::LoadLibraryA(name.c_str()))
+{}
+
+PFD_INLINE internal::platform::dll::~dll()
+{
+    if (handle)
+        ::FreeLibrary(handle);
+}
+#endif // _WIN32
+
+// new_style_context implementation
+
+#if _WIN32
+PFD_INLINE internal::platform::new_style_context::new_style_context()
+{
+    // Only create one activation context for the whole app lifetime.
+    static HANDLE hctx = create();
+
+    if (hctx != INVALID_HANDLE_VALUE)
+        ActivateActCtx(hctx, &m_cookie);
+}
+
+PFD_INLINE internal::platform::new_style_context::~new_style_context()
+{
+    DeactivateActCtx(0, m_cookie);
+}
+
+PFD_INLINE HANDLE internal::platform::new_style_context::create()
+{
+    // This “hack” seems to be necessary for this code to work on windows XP.
+    // Without it, dialogs do not show and close immediately. GetError()
+    // returns 0 so I don’t know what causes this. I was not able to reproduce
+    // this behavior on Windows 7 and 10 but just in case, let it be here for
+    // those versions too.
+    // This hack is not required if other dialogs are used (they load comdlg32
+    // automatically), only if message boxes are used.
+    dll comdlg32("comdlg32.dll");
+
+    // Using approach as shown here: https://stackoverflow.com/a/10444161
+    UINT len = ::GetSystemDirectoryA(nullptr, 0);
+    std::string sys_dir(len, '\0');
+    ::GetSystemDirectoryA(&sys_dir[0], len);
+
+    ACTCTXA act_ctx =
+    {
+        // Do not set flag ACTCTX_FLAG_SET_PROCESS_DEFAULT, since it causes a
+        // crash with error “default context is already set”.
+        sizeof(act_ctx),
+        ACTCTX_FLAG_RESOURCE_NAME_VALID | ACTCTX_FLAG_ASSEMBLY_DIRECTORY_VALID,
+        "shell32.dll", 0, 0, sys_dir.c_str(), (LPCSTR)124,
+    };
+
+    return ::CreateActCtxA(&act_ctx);
+}
+#endif // _WIN32
+
+// dialog implementation
+
+PFD_INLINE bool internal::dialog::ready(int timeout /* = default_wait_timeout */)
+{
+    return m_async->ready(timeout);
+}
+
+PFD_INLINE bool internal::dialog::ready(std::chrono::steady_clock::time_point deadline)
+{
+    return m_async->ready(deadline);
+}
+
+PFD_INLINE int internal::dialog::native_handle()
+{
+    return m_async->native_handle();
+}
+
+PFD_INLINE void internal::dialog::track(void *tag)
+{
+    m_async->then([tag](std::string const &, int)
+    {
+        completion_queue::instance().push(tag);
+    }, false);
+}
+
+PFD_INLINE void internal::dialog::then(executor::callback const &cb, callback_queue *queue)
+{
+    if (!queue)
+    {
+        m_async->then(cb);
+        return;
+    }
+
+    // Posting to the queue never blocks
+    m_async->then([cb, queue](std::string const &out, int exit_code)
+    {
+        queue->post([cb, out, exit_code]() { cb(out, exit_code); });
+    }, false);
+}
 
-    if (hctx != INVALID_HANDLE_VALUE)
-        ActivateActCtx(hctx, &m_cookie);
+PFD_INLINE void internal::dialog::expire_after(int timeout, std::string const &out, int exit_code)
+{
+    m_async->expire_at(deadline_after(timeout), out, exit_code);
 }
 
-inline internal::platform::new_style_context::~new_style_context()
+PFD_INLINE void internal::dialog::cancel()
 {
-    DeactivateActCtx(0, m_cookie);
+    m_async->cancel();
 }
 
-inline HANDLE internal::platform::new_style_context::create()
+PFD_INLINE void internal::dialog::on_drop(drop_policy policy)
 {
-    // This “hack” seems to be necessary for this code to work on windows XP.
-    // Without it, dialogs do not show and close immediately. GetError()
-    // returns 0 so I don’t know what causes this. I was not able to reproduce
-    // this behavior on Windows 7 and 10 but just in case, let it be here for
-    // those versions too.
-    // This hack is not required if other dialogs are used (they load comdlg32
-    // automatically), only if message boxes are used.
-    dll comdlg32("comdlg32.dll");
+    m_owner->m_policy = policy;
+}
 
-    // Using approach as shown here: https://stackoverflow.com/a/10444161
-    UINT len = ::GetSystemDirectoryA(nullptr, 0);
-    std::string sys_dir(len, '\0');
-    ::GetSystemDirectoryA(&sys_dir[0], len);
+PFD_INLINE internal::dialog::dialog()
+  : m_scan_result(scan()),
+    m_scan(m_scan_result.get()),
+    m_async(std::make_shared<executor>()),
+    m_owner(std::make_shared<owner>(m_async))
+{
+}
 
-    ACTCTXA act_ctx =
-    {
-        // Do not set flag ACTCTX_FLAG_SET_PROCESS_DEFAULT, since it causes a
-        // crash with error “default context is already set”.
-        sizeof(act_ctx),
-        ACTCTX_FLAG_RESOURCE_NAME_VALID | ACTCTX_FLAG_ASSEMBLY_DIRECTORY_VALID,
-        "shell32.dll", 0, 0, sys_dir.c_str(), (LPCSTR)124,
-    };
+// At most one of is_osascript(), is_zenity() and is_kdialog() is true; it
+// tells which helper desktop_helper() returned.
 
-    return ::CreateActCtxA(&act_ctx);
+PFD_INLINE bool internal::dialog::is_osascript() const
+{
+#if PFD_BACKEND == PFD_BACKEND_OSASCRIPT || (__APPLE__ && PFD_BACKEND == PFD_BACKEND_AUTO)
+    return true;
+#else
+    return false;
+#endif
 }
-#endif // _WIN32
-
-// dialog implementation
 
-inline bool internal::dialog::ready(int timeout /* = default_wait_timeout */)
+PFD_INLINE bool internal::dialog::is_zenity() const
 {
-    return m_async->ready(timeout);
+#if PFD_BACKEND != PFD_BACKEND_AUTO || __APPLE__
+    return PFD_BACKEND == PFD_BACKEND_ZENITY;
+#else
+    return m_scan->enabled[size_t(helper::zenity)] ||
+           m_scan->enabled[size_t(helper::matedialog)] ||
+           m_scan->enabled[size_t(helper::qarma)];
+#endif
 }
 
-inline internal::dialog::dialog()
-  : m_async(std::make_shared<executor>())
+PFD_INLINE bool internal::dialog::is_kdialog() const
 {
-    if (!flags(flag::is_scanned))
-    {
-#if _WIN32
-        flags(flag::is_vista) = is_vista();
-#elif !__APPLE__
-        flags(flag::has_zenity) = check_program("zenity");
-        flags(flag::has_matedialog) = check_program("matedialog");
-        flags(flag::has_qarma) = check_program("qarma");
-        flags(flag::has_kdialog) = check_program("kdialog");
-
-        // If multiple helpers are available, try to default to the best one
-        if (flags(flag::has_zenity) && flags(flag::has_kdialog))
-        {
-            auto desktop_name = std::getenv("XDG_SESSION_DESKTOP");
-            if (desktop_name && desktop_name == std::string("gnome"))
-                flags(flag::has_kdialog) = false;
-            else if (desktop_name && desktop_name == std::string("KDE"))
-                flags(flag::has_zenity) = false;
-        }
+#if PFD_BACKEND != PFD_BACKEND_AUTO || __APPLE__
+    return PFD_BACKEND == PFD_BACKEND_KDIALOG;
+#else
+    return m_scan->enabled[size_t(helper::kdialog)] && !is_zenity();
 #endif
-        flags(flag::is_scanned) = true;
-    }
 }
 
-inline std::string internal::dialog::desktop_helper() const
+PFD_INLINE std::string internal::dialog::desktop_helper() const
 {
-#if __APPLE__
+#if PFD_BACKEND == PFD_BACKEND_ZENITY
+    return "zenity";
+#elif PFD_BACKEND == PFD_BACKEND_KDIALOG
+    return "kdialog";
+#elif PFD_BACKEND == PFD_BACKEND_OSASCRIPT || __APPLE__
     return "osascript";
 #else
-    return flags(flag::has_zenity) ? "zenity"
-         : flags(flag::has_matedialog) ? "matedialog"
-         : flags(flag::has_qarma) ? "qarma"
-         : flags(flag::has_kdialog) ? "kdialog"
-         : "echo";
+    // Use absolute paths so that spawning the helper needs no PATH search
+    for (size_t i = 0; i < size_t(helper::max_helper); ++i)
+        if (m_scan->enabled[i])
+            return m_scan->path[i];
+    return "echo";
 #endif
 }
 
-inline std::string internal::dialog::buttons_to_name(choice _choice) const
+PFD_INLINE std::string internal::dialog::buttons_to_name(choice _choice) const
 {
     switch (_choice)
     {
@@ -725,7 +4203,7 @@ inline std::string internal::dialog::buttons_to_name(choice _choice) const
     }
 }
 
-inline std::string internal::dialog::get_icon_name(icon _icon) const
+PFD_INLINE std::string internal::dialog::get_icon_name(icon _icon) const
 {
     switch (_icon)
     {
@@ -745,55 +4223,266 @@ inline std::string internal::dialog::get_icon_name(icon _icon) const
 // Properly quote a string for Powershell: replace ' or " with '' or ""
 // FIXME: we should probably get rid of newlines!
 // FIXME: the \" sequence seems unsafe, too!
-inline std::string internal::dialog::powershell_quote(std::string const &str) const
+PFD_INLINE std::string internal::dialog::powershell_quote(std::string const &str) const
 {
-    return "'" + std::regex_replace(str, std::regex("['\"]"), "$&$&") + "'";
+    auto is_special = [](char c) { return c == '\'' || c == '"'; };
+
+    // Count the quotes first, so that the result is only allocated once
+    std::string ret;
+    ret.reserve(str.size() + size_t(std::count_if(str.begin(), str.end(), is_special)) + 2);
+    ret += '\'';
+    for (char c : str)
+    {
+        if (is_special(c))
+            ret += c;
+        ret += c;
+    }
+    ret += '\'';
+    return ret;
 }
 
-// Properly quote a string for osascript: replace ' with '\'' and \ or " with \\ or \"
-inline std::string internal::dialog::osascript_quote(std::string const &str) const
+// Properly quote a string for osascript: replace \ or " with \\ or \"
+PFD_INLINE std::string internal::dialog::osascript_quote(std::string const &str) const
 {
-    return "\"" + std::regex_replace(std::regex_replace(str,
-                      std::regex("[\\\\\"]"), "\\$&"), std::regex("'"), "'\\''") + "\"";
+    auto is_special = [](char c) { return c == '\\' || c == '"'; };
+
+    std::string ret;
+    ret.reserve(str.size() + size_t(std::count_if(str.begin(), str.end(), is_special)) + 2);
+    ret += '"';
+    for (char c : str)
+    {
+        if (is_special(c))
+            ret += '\\';
+        ret += c;
+    }
+    ret += '"';
+    return ret;
 }
 
 // Properly quote a string for the shell: just replace ' with '\''
-inline std::string internal::dialog::shell_quote(std::string const &str) const
+PFD_INLINE std::string internal::dialog::shell_quote(std::string const &str) const
+{
+    std::string ret;
+    ret.reserve(str.size() + 3 * size_t(std::count(str.begin(), str.end(), '\'')) + 2);
+    ret += '\'';
+    for (char c : str)
+    {
+        if (c == '\'')
+            ret += "'\\'";
+        ret += c;
+    }
+    ret += '\'';
+    return ret;
+}
+
+#if !_WIN32
+PFD_INLINE void internal::dialog::start_process(std::function<std::vector<std::string>()> const &build,
+                                           std::function<int_map<std::string>()> const &answers,
+                                           std::function<std::string(int)> const &tty_job,
+                                           bool has_window /* = true */)
+{
+    // The helpers to try, in order of preference: first the usable ones,
+    // then those ruled out by the desktop heuristics
+    std::vector<scan_result> candidates;
+#if PFD_BACKEND == PFD_BACKEND_AUTO && !__APPLE__
+    for (bool enabled : { true, false })
+    {
+        for (size_t i = 0; i < size_t(helper::max_helper); ++i)
+        {
+            if (m_scan->path[i].empty() || m_scan->enabled[i] != enabled)
+                continue;
+            candidates.emplace_back();
+            candidates.back().path[i] = m_scan->path[i];
+            candidates.back().enabled[i] = true;
+            candidates.back().is_forced = m_scan->is_forced;
+        }
+    }
+#endif
+
+    // Without a display, no helper can work, so ask on the terminal instead;
+    // likewise if there is no helper at all, or if asked to.
+#if __APPLE__ || PFD_BACKEND == PFD_BACKEND_OSASCRIPT
+    bool use_tty = false;
+#elif PFD_BACKEND == PFD_BACKEND_AUTO
+    bool use_tty = m_scan->use_tty || !m_scan->has_display || candidates.empty();
+#else
+    bool use_tty = !m_scan->has_display;
+#endif
+    if (use_tty)
+    {
+        if (flags(flag::is_verbose))
+            fprintf(stderr, "pfd: no display or desktop helper, asking on the terminal\n");
+        if (m_async->start_job(tty_job) && flags(flag::has_reactor))
+            m_async->watch();
+        return;
+    }
+
+    std::vector<std::vector<std::string>> commands;
+    std::vector<int_map<std::string>> answer_list;
+    auto primary = m_scan;
+    for (size_t i = 0; i == 0 || i < candidates.size(); ++i)
+    {
+        if (i < candidates.size())
+            m_scan = &candidates[i];
+        commands.push_back(build());
+        answer_list.push_back(answers ? answers() : int_map<std::string>());
+    }
+    m_scan = primary;
+
+    // The helper is spawned without a shell; quoting is only needed so
+    // that the logged command lines can be pasted into one.
+    std::vector<std::string> log;
+    if (flags(flag::is_verbose))
+    {
+        for (auto const &command : commands)
+        {
+            std::string line;
+            for (auto const &arg : command)
+                line += (line.empty() ? "" : " ") + shell_quote(arg);
+            log.push_back(line);
+        }
+        log.push_back("no helper could show the dialog, asking on the terminal");
+    }
+
+    // Only a helper that shows a window can be checked on; osascript’s
+    // belongs to another process
+#if __APPLE__ || PFD_BACKEND == PFD_BACKEND_OSASCRIPT
+    bool watchdog = false;
+#else
+    auto env_watchdog = std::getenv("PFD_WATCHDOG");
+    bool watchdog = has_window && (flags(flag::use_watchdog)
+                                    || (env_watchdog && std::string(env_watchdog) == "1"));
+#endif
+    // A forced helper that cannot be spawned is replaced by a scan rather
+    // than by the terminal
+    if (m_async->start_process(commands, answer_list, log, tty_job, watchdog,
+                               !m_scan->is_forced))
+    {
+        if (flags(flag::has_reactor))
+            m_async->watch();
+        return;
+    }
+
+    if (!m_scan->is_forced)
+        return;
+
+    if (flags(flag::is_verbose))
+        fprintf(stderr, "pfd: forced helper failed to start, scanning instead\n");
+
+    forced_failed();
+    m_scan_result = scan();
+    m_scan = m_scan_result.get();
+    start_process(build, answers, tty_job, has_window);
+}
+
+PFD_INLINE std::vector<std::string> internal::dialog::fill(command_template t,
+                                                      std::string const &value) const
 {
-    return "'" + std::regex_replace(str, std::regex("'"), "'\\''") + "'";
+    if (t.slot_arg < t.args.size() && (t.prefix.empty() || !value.empty()))
+        t.args[t.slot_arg].insert(t.slot_offset,
+                                  t.prefix + (t.osascript ? osascript_quote(value) : value));
+    return std::move(t.args);
 }
+#endif
 
-// Check whether a program is present using “which”.
-inline bool internal::dialog::check_program(std::string const &program)
+// Dialog spec implementation
+
+struct file_dialog_spec::data
 {
+    std::string title;
+    std::vector<std::string> filters;
+    opt options;
 #if _WIN32
-    (void)program;
-    return false;
+    // The filters the way GetOpenFileNameW() wants them
+    std::string filter_list;
 #else
-    int exit_code = -1;
-    m_async->start("which " + program + " 2>/dev/null");
-    m_async->result(&exit_code);
-    return exit_code == 0;
+    // The commands built so far, for each dialog type and helper
+    struct entry
+    {
+        int type;
+        std::string helper;
+        internal::command_template command;
+    };
+    std::mutex mutex;
+    std::vector<entry> commands;
+#endif
+};
+
+PFD_INLINE file_dialog_spec::file_dialog_spec(std::string const &title,
+                                          std::vector<std::string> filters /* = internal::default_filters() */,
+                                          opt options /* = opt::none */)
+  : m_data(std::make_shared<data>())
+{
+    m_data->title = title;
+    m_data->filters = std::move(filters);
+    m_data->options = options;
+
+#if _WIN32
+    m_data->filter_list = internal::filter_list(m_data->filters);
+#endif
+}
+
+struct message_spec::data
+{
+    std::string title;
+    choice _choice;
+    icon _icon;
+#if !_WIN32
+    // The commands built so far, for each helper, with their exit codes
+    struct entry
+    {
+        std::string helper;
+        internal::command_template command;
+        internal::int_map<button> mappings;
+    };
+    std::mutex mutex;
+    std::vector<entry> commands;
 #endif
+};
+
+PFD_INLINE message_spec::message_spec(std::string const &title,
+                                  choice _choice /* = choice::ok_cancel */,
+                                  icon _icon /* = icon::info */)
+  : m_data(std::make_shared<data>())
+{
+    m_data->title = title;
+    m_data->_choice = _choice;
+    m_data->_icon = _icon;
 }
 
 // file_dialog implementation
 
-inline internal::file_dialog::file_dialog(type in_type,
+PFD_INLINE std::vector<std::string> internal::default_filters()
+{
+    return { "All Files", "*" };
+}
+
+PFD_INLINE internal::file_dialog::file_dialog(type in_type,
             std::string const &title,
             std::string const &default_path /* = "" */,
             std::vector<std::string> filters /* = {} */,
             opt options /* = opt::none */)
+{
+    init(in_type, title, default_path, filters, options, nullptr);
+}
+
+PFD_INLINE internal::file_dialog::file_dialog(type in_type,
+            file_dialog_spec const &spec,
+            std::string const &default_path)
+{
+    init(in_type, spec.m_data->title, default_path, spec.m_data->filters,
+         spec.m_data->options, &spec);
+}
+
+PFD_INLINE void internal::file_dialog::init(type in_type,
+            std::string const &title,
+            std::string const &default_path,
+            std::vector<std::string> const &filters,
+            opt options,
+            file_dialog_spec const *spec)
 {
 #if _WIN32
-    std::string filter_list;
-    std::regex whitespace("  *");
-    for (size_t i = 0; i + 1 < filters.size(); i += 2)
-    {
-        filter_list += filters[i] + '\0';
-        filter_list += std::regex_replace(filters[i + 1], whitespace, ";") + '\0';
-    }
-    filter_list += '\0';
+    auto filter_list = spec ? spec->m_data->filter_list : internal::filter_list(filters);
 
     m_async->start([this, in_type, title, default_path, filter_list,
                     options](int *exit_code) -> std::string
@@ -910,7 +4599,8 @@ inline internal::file_dialog::file_dialog(type in_type,
         if (get_open_file_name(&ofn) == 0)
             return "";
 
-        std::string prefix;
+        // Report one file per line, like the desktop helpers do
+        std::string ret, prefix;
         for (wchar_t const *p = woutput.c_str(); *p; )
         {
             auto filename = internal::wstr2str(p);
@@ -924,35 +4614,87 @@ inline internal::file_dialog::file_dialog(type in_type,
                 continue;
             }
 
-            m_vector_result.push_back(prefix + filename);
+            ret += prefix + filename + '\n';
         }
 
-        return "";
+        return ret;
     });
 #else
-    auto command = desktop_helper();
+    // Folder selection has no filters
+    static std::vector<std::string> const no_filters;
+    auto const &used_filters = in_type == type::folder ? no_filters : filters;
+
+    auto build = [&]()
+    {
+        return helper_command(in_type, title, default_path, used_filters, options, spec);
+    };
+
+    auto request = in_type == type::open ? tty::request::open_file
+                 : in_type == type::save ? tty::request::save_file
+                 : tty::request::select_folder;
+    start_process(build, nullptr,
+                  [=](int sock) { return tty::file(request, title, default_path, used_filters, options, sock); });
+#endif
+}
+
+#if !_WIN32
+PFD_INLINE std::vector<std::string> internal::file_dialog::helper_command(type in_type,
+            std::string const &title,
+            std::string const &default_path,
+            std::vector<std::string> const &filters,
+            opt options,
+            file_dialog_spec const *spec) const
+{
+    if (!spec)
+        return fill(helper_template(in_type, title, filters, options), default_path);
+
+    // Only build the command once per helper, and fill in the default path
+    auto const &data = spec->m_data;
+    auto name = desktop_helper();
+    std::unique_lock<std::mutex> lock(data->mutex);
+    for (auto const &entry : data->commands)
+        if (entry.type == int(in_type) && entry.helper == name)
+            return fill(entry.command, default_path);
+    auto command = helper_template(in_type, title, filters, options);
+    data->commands.push_back({ int(in_type), name, command });
+    return fill(command, default_path);
+}
+
+PFD_INLINE internal::command_template internal::file_dialog::helper_template(type in_type,
+            std::string const &title,
+            std::vector<std::string> const &filters,
+            opt options) const
+{
+    (void)options; // not used by every backend
 
+    command_template t;
+    auto &command = t.args;
+    command.push_back(desktop_helper());
+
+#if PFD_HAS_BACKEND(OSASCRIPT)
     if (is_osascript())
     {
-        command += " -e 'set ret to choose";
+        std::string script = "set ret to choose";
         switch (in_type)
         {
             case type::save:
-                command += " file name";
+                script += " file name";
                 break;
             case type::open: default:
-                command += " file";
+                script += " file";
                 if (options & opt::multiselect)
-                    command += " with multiple selections allowed";
+                    script += " with multiple selections allowed";
                 break;
             case type::folder:
-                command += " folder";
+                script += " folder";
                 break;
         }
 
-        if (default_path.size())
-            command += " default location " + osascript_quote(default_path);
-        command += " with prompt " + osascript_quote(title);
+        // The default location goes here
+        t.slot_offset = script.size();
+        t.osascript = true;
+        t.prefix = " default location ";
+        script += " with prompt " + osascript_quote(title);
 
         if (in_type == type::open)
         {
@@ -964,14 +4706,10 @@ inline internal::file_dialog::file_dialog(type in_type,
             // Split the pattern list to check whether "*" is in there; if it
             // is, we have to disable filters because there is no mechanism in
             // OS X for the user to override the filter.
-            std::regex sep("\\s+");
             std::string filter_list;
             bool has_filter = true;
-            std::sregex_token_iterator iter(patterns.begin(), patterns.end(), sep, -1);
-            std::sregex_token_iterator end;
-            for ( ; iter != end; ++iter)
+            for (auto const &pat : internal::split(patterns))
             {
-                auto pat = iter->str();
                 if (pat == "*" || pat == "*.*")
                     has_filter = false;
                 else if (internal::starts_with(pat, "*."))
@@ -979,100 +4717,114 @@ inline internal::file_dialog::file_dialog(type in_type,
                                    osascript_quote(pat.substr(2, pat.size() - 2));
             }
             if (has_filter && filter_list.size() > 0)
-                command += " of type {" + filter_list + "}";
+                script += " of type {" + filter_list + "}";
         }
 
         if (in_type == type::open && (options & opt::multiselect))
         {
-            command += "\nset s to \"\"";
-            command += "\nrepeat with i in ret";
-            command += "\n  set s to s & (POSIX path of i) & \"\\n\"";
-            command += "\nend repeat";
-            command += "\ncopy s to stdout'";
+            script += "\nset s to \"\"";
+            script += "\nrepeat with i in ret";
+            script += "\n  set s to s & (POSIX path of i) & \"\\n\"";
+            script += "\nend repeat";
+            script += "\ncopy s to stdout";
         }
         else
         {
-            command += "\nPOSIX path of ret'";
+            script += "\nPOSIX path of ret";
         }
+
+        command.push_back("-e");
+        t.slot_arg = command.size();
+        command.push_back(script);
     }
-    else if (is_zenity())
+#endif
+#if PFD_HAS_BACKEND(ZENITY)
+    if (is_zenity())
     {
-        command += " --file-selection --filename=" + shell_quote(default_path)
-                 + " --title " + shell_quote(title)
-                 + " --separator='\n'";
+        command.push_back("--file-selection");
+        t.slot_arg = command.size();
+        command.push_back("--filename=");
+        t.slot_offset = command.back().size();
+        command.push_back("--title");
+        command.push_back(title);
+        command.push_back("--separator=\n");
 
         for (size_t i = 0; i < filters.size() / 2; ++i)
-            command += " --file-filter " + shell_quote(filters[2 * i] + "|" + filters[2 * i + 1]);
+        {
+            command.push_back("--file-filter");
+            command.push_back(filters[2 * i] + "|" + filters[2 * i + 1]);
+        }
 
         if (in_type == type::save)
-            command += " --save";
+            command.push_back("--save");
         if (in_type == type::folder)
-            command += " --directory";
+            command.push_back("--directory");
         if (!(options & opt::force_overwrite))
-            command += " --confirm-overwrite";
+            command.push_back("--confirm-overwrite");
         if (options & opt::multiselect)
-            command += " --multiple";
+            command.push_back("--multiple");
     }
-    else if (is_kdialog())
+#endif
+#if PFD_HAS_BACKEND(KDIALOG)
+    if (is_kdialog())
     {
         switch (in_type)
         {
-            case type::save: command += " --getsavefilename"; break;
-            case type::open: command += " --getopenfilename"; break;
-            case type::folder: command += " --getexistingdirectory"; break;
+            case type::save: command.push_back("--getsavefilename"); break;
+            case type::open: command.push_back("--getopenfilename"); break;
+            case type::folder: command.push_back("--getexistingdirectory"); break;
         }
-        command += " " + shell_quote(default_path);
+        t.slot_arg = command.size();
+        command.push_back("");
 
         std::string filter;
         for (size_t i = 0; i < filters.size() / 2; ++i)
             filter += (i == 0 ? "" : " | ") + filters[2 * i] + "(" + filters[2 * i + 1] + ")";
-        command += " " + shell_quote(filter);
+        command.push_back(filter);
 
-        command += " --title " + shell_quote(title);
+        command.push_back("--title");
+        command.push_back(title);
     }
+#endif
 
-    if (flags(flag::is_verbose))
-        std::cerr << "pfd: " << command << std::endl;
-
-    m_async->start(command);
+    return t;
+}
 #endif
+
+PFD_INLINE std::string internal::file_dialog::string_result()
+{
+    return decode_string(m_async->result());
 }
 
-inline std::string internal::file_dialog::string_result()
+PFD_INLINE std::vector<std::string> internal::file_dialog::vector_result()
+{
+    return decode_vector(m_async->result());
+}
+
+PFD_INLINE std::string internal::file_dialog::decode_string(std::string const &out)
 {
-#if _WIN32
-    return m_async->result();
-#else
     // Strip the newline character
-    auto ret = m_async->result();
-    return ret.back() == '\n' ? ret.substr(0, ret.size() - 1) : ret;
-#endif
+    return !out.empty() && out.back() == '\n' ? out.substr(0, out.size() - 1) : out;
 }
 
-inline std::vector<std::string> internal::file_dialog::vector_result()
+PFD_INLINE std::vector<std::string> internal::file_dialog::decode_vector(std::string out)
 {
-#if _WIN32
-    m_async->result();
-    return m_vector_result;
-#else
     std::vector<std::string> ret;
-    auto result = m_async->result();
     for (;;)
     {
         // Split result along newline characters
-        auto i = result.find('\n');
+        auto i = out.find('\n');
         if (i == 0 || i == std::string::npos)
             break;
-        ret.push_back(result.substr(0, i));
-        result = result.substr(i + 1, result.size());
+        ret.push_back(out.substr(0, i));
+        out = out.substr(i + 1, out.size());
     }
     return ret;
-#endif
 }
 
 #if _WIN32
 // Use a static function to pass as BFFCALLBACK for legacy folder select
-inline int CALLBACK internal::file_dialog::bffcallback(HWND hwnd, UINT uMsg,
+PFD_INLINE int CALLBACK internal::file_dialog::bffcallback(HWND hwnd, UINT uMsg,
                                                        LPARAM, LPARAM pData)
 {
     auto inst = (file_dialog *)pData;
@@ -1085,7 +4837,7 @@ inline int CALLBACK internal::file_dialog::bffcallback(HWND hwnd, UINT uMsg,
     return 0;
 }
 
-inline std::string internal::file_dialog::select_folder_vista(IFileDialog *ifd, bool force_path)
+PFD_INLINE std::string internal::file_dialog::select_folder_vista(IFileDialog *ifd, bool force_path)
 {
     std::string result;
 
@@ -1150,7 +4902,7 @@ inline std::string internal::file_dialog::select_folder_vista(IFileDialog *ifd,
 
 // notify implementation
 
-inline notify::notify(std::string const &title,
+PFD_INLINE notify::notify(std::string const &title,
                       std::string const &message,
                       icon _icon /* = icon::info */)
 {
@@ -1219,41 +4971,85 @@ inline notify::notify(std::string const &title,
     // Display the new icon
     Shell_NotifyIconW(NIM_ADD, nid.get());
 #else
-    auto command = desktop_helper();
+    // A notification may not have a window of its own
+    start_process([&]() { return helper_command(title, message, _icon); },
+                  nullptr,
+                  [=](int sock) { return internal::tty::notify(title, message, _icon, sock); },
+                  false);
+
+    // Nobody waits for a notification, which may stay on screen for a
+    // while, so let the reaper thread collect its helper
+    on_drop(drop_policy::detach);
+#endif
+}
+
+#if !_WIN32
+PFD_INLINE std::vector<std::string> notify::helper_command(std::string const &title,
+                                                      std::string const &message,
+                                                      icon _icon) const
+{
+    (void)_icon; // not used by every backend
+
+    std::vector<std::string> command = { desktop_helper() };
 
+#if PFD_HAS_BACKEND(OSASCRIPT)
     if (is_osascript())
     {
-        command += " -e 'display notification " + osascript_quote(message) +
-                   "     with title " + osascript_quote(title) + "'";
+        command.push_back("-e");
+        command.push_back("display notification " + osascript_quote(message) +
+                          "     with title " + osascript_quote(title));
     }
-    else if (is_zenity())
+#endif
+#if PFD_HAS_BACKEND(ZENITY)
+    if (is_zenity())
     {
-        command += " --notification"
-                   " --window-icon " + get_icon_name(_icon) +
-                   " --text " + shell_quote(title + "\n" + message);
+        command.push_back("--notification");
+        command.push_back("--window-icon");
+        command.push_back(get_icon_name(_icon));
+        command.push_back("--text");
+        command.push_back(title + "\n" + message);
     }
-    else if (is_kdialog())
+#endif
+#if PFD_HAS_BACKEND(KDIALOG)
+    if (is_kdialog())
     {
-        command += " --icon " + get_icon_name(_icon) +
-                   " --title " + shell_quote(title) +
-                   " --passivepopup " + shell_quote(message) +
-                   " 5";
+        command.push_back("--icon");
+        command.push_back(get_icon_name(_icon));
+        command.push_back("--title");
+        command.push_back(title);
+        command.push_back("--passivepopup");
+        command.push_back(message);
+        command.push_back("5");
     }
-
-    if (flags(flag::is_verbose))
-        std::cerr << "pfd: " << command << std::endl;
-
-    m_async->start(command);
 #endif
+
+    return command;
 }
+#endif
 
 // message implementation
 
-inline message::message(std::string const &title,
+PFD_INLINE message::message(std::string const &title,
                         std::string const &text,
                         choice _choice /* = choice::ok_cancel */,
                         icon _icon /* = icon::info */)
 {
+    init(title, text, _choice, _icon, nullptr);
+}
+
+PFD_INLINE message::message(message_spec const &spec, std::string const &text)
+{
+    init(spec.m_data->title, text, spec.m_data->_choice, spec.m_data->_icon, &spec);
+}
+
+PFD_INLINE void message::init(std::string const &title,
+                          std::string const &text,
+                          choice _choice,
+                          icon _icon,
+                          message_spec const *spec)
+{
+    (void)spec; // not used by every backend
+
 #if _WIN32
     UINT style = MB_TOPMOST;
     switch (_icon)
@@ -1313,139 +5109,248 @@ inline message::message(std::string const &title,
         return 0;
     }, full_message.c_str(), _choice == choice::ok_cancel));
 #else
-    auto command = desktop_helper();
+    auto answers = [this]()
+    {
+        internal::int_map<std::string> ret;
+        for (auto const &it : m_mappings)
+            ret[it.first] = encode(it.second);
+        return ret;
+    };
+    auto tty_job = [=](int sock)
+    {
+        return encode(internal::tty::message(title, text, _choice, _icon, sock));
+    };
+
+    auto build = [&]()
+    {
+        return helper_command(title, text, _choice, _icon, spec, m_mappings);
+    };
+    start_process(build, answers, tty_job);
+
+    // The executor already turns exit codes into answers for whichever
+    // helper it ended up using
+    m_mappings.clear();
+#endif
+}
+
+#if !_WIN32
+PFD_INLINE std::vector<std::string> message::helper_command(std::string const &title,
+                                                        std::string const &text,
+                                                        choice _choice,
+                                                        icon _icon,
+                                                        message_spec const *spec,
+                                                        internal::int_map<button> &mappings) const
+{
+    mappings.clear();
+    if (!spec)
+        return fill(helper_template(title, _choice, _icon, mappings), text);
+
+    // Only build the command once per helper, and fill in the text
+    auto const &data = spec->m_data;
+    auto name = desktop_helper();
+    std::unique_lock<std::mutex> lock(data->mutex);
+    for (auto const &entry : data->commands)
+        if (entry.helper == name)
+        {
+            mappings = entry.mappings;
+            return fill(entry.command, text);
+        }
+    auto command = helper_template(title, _choice, _icon, mappings);
+    data->commands.push_back({ name, command, mappings });
+    return fill(command, text);
+}
+
+PFD_INLINE internal::command_template message::helper_template(std::string const &title,
+                                                          choice _choice,
+                                                          icon _icon,
+                                                          internal::int_map<button> &mappings) const
+{
+    (void)mappings; // not used by every backend
+
+    internal::command_template t;
+    auto &command = t.args;
+    command.push_back(desktop_helper());
 
+#if PFD_HAS_BACKEND(OSASCRIPT)
     if (is_osascript())
     {
-        command += " -e 'display dialog " + osascript_quote(text) +
-                   "     with title " + osascript_quote(title);
+        // The text goes after “display dialog”
+        std::string script = "display dialog ";
+        t.slot_offset = script.size();
+        t.osascript = true;
+        script += "     with title " + osascript_quote(title);
         switch (_choice)
         {
             case choice::ok_cancel:
-                command += "buttons {\"OK\", \"Cancel\"} "
+                script += "buttons {\"OK\", \"Cancel\"} "
                            "default button \"OK\" "
                            "cancel button \"Cancel\"";
-                m_mappings[256] = button::cancel;
+                mappings[256] = button::cancel;
                 break;
             case choice::yes_no:
-                command += "buttons {\"Yes\", \"No\"} "
+                script += "buttons {\"Yes\", \"No\"} "
                            "default button \"Yes\" "
                            "cancel button \"No\"";
-                m_mappings[256] = button::no;
+                mappings[256] = button::no;
                 break;
             case choice::yes_no_cancel:
-                command += "buttons {\"Yes\", \"No\", \"Cancel\"} "
+                script += "buttons {\"Yes\", \"No\", \"Cancel\"} "
                            "default button \"Yes\" "
                            "cancel button \"Cancel\"";
-                m_mappings[256] = button::cancel;
+                mappings[256] = button::cancel;
                 break;
             case choice::retry_cancel:
-                command += "buttons {\"Retry\", \"Cancel\"} "
+                script += "buttons {\"Retry\", \"Cancel\"} "
                     "default button \"Retry\" "
                     "cancel button \"Cancel\"";
-                m_mappings[256] = button::cancel;
+                mappings[256] = button::cancel;
                 break;
             case choice::abort_retry_ignore:
-                command += "buttons {\"Abort\", \"Retry\", \"Ignore\"} "
+                script += "buttons {\"Abort\", \"Retry\", \"Ignore\"} "
                     "default button \"Retry\" "
                     "cancel button \"Retry\"";
-                m_mappings[256] = button::cancel;
+                mappings[256] = button::cancel;
                 break;
             case choice::ok: default:
-                command += "buttons {\"OK\"} "
+                script += "buttons {\"OK\"} "
                            "default button \"OK\" "
                            "cancel button \"OK\"";
-                m_mappings[256] = button::ok;
+                mappings[256] = button::ok;
                 break;
         }
-        command += " with icon ";
+        script += " with icon ";
         switch (_icon)
         {
             #define PFD_OSX_ICON(n) "alias ((path to library folder from system domain) as text " \
                 "& \"CoreServices:CoreTypes.bundle:Contents:Resources:" n ".icns\")"
-            case icon::info: default: command += PFD_OSX_ICON("ToolBarInfo"); break;
-            case icon::warning: command += "caution"; break;
-            case icon::error: command += "stop"; break;
-            case icon::question: command += PFD_OSX_ICON("GenericQuestionMarkIcon"); break;
+            case icon::info: default: script += PFD_OSX_ICON("ToolBarInfo"); break;
+            case icon::warning: script += "caution"; break;
+            case icon::error: script += "stop"; break;
+            case icon::question: script += PFD_OSX_ICON("GenericQuestionMarkIcon"); break;
             #undef PFD_OSX_ICON
         }
-        command += "'";
+
+        command.push_back("-e");
+        t.slot_arg = command.size();
+        command.push_back(script);
     }
-    else if (is_zenity())
+#endif
+#if PFD_HAS_BACKEND(ZENITY)
+    if (is_zenity())
     {
         switch (_choice)
         {
             case choice::ok_cancel:
-                command += " --question --ok-label=OK --cancel-label=Cancel"; break;
+                command.insert(command.end(), { "--question", "--ok-label=OK", "--cancel-label=Cancel" }); break;
             case choice::yes_no:
                 // Do not use standard --question because it causes “No” to return -1,
                 // which is inconsistent with the “Yes/No/Cancel” mode below.
-                command += " --question --switch --extra-button No --extra-button Yes"; break;
+                command.insert(command.end(), { "--question", "--switch", "--extra-button", "No", "--extra-button", "Yes" }); break;
             case choice::yes_no_cancel:
-                command += " --question --switch --extra-button No --extra-button Yes --extra-button Cancel"; break;
+                command.insert(command.end(), { "--question", "--switch", "--extra-button", "No", "--extra-button", "Yes", "--extra-button", "Cancel" }); break;
             case choice::retry_cancel:
-                command += " --question --switch --extra-button Retry --extra-button Cancel"; break;
+                command.insert(command.end(), { "--question", "--switch", "--extra-button", "Retry", "--extra-button", "Cancel" }); break;
             case choice::abort_retry_ignore:
-                command += " --question --switch --extra-button Abort --extra-button Retry --extra-button Ignore"; break;
+                command.insert(command.end(), { "--question", "--switch", "--extra-button", "Abort", "--extra-button", "Retry", "--extra-button", "Ignore" }); break;
             default:
                 switch (_icon)
                 {
-                    case icon::error: command += " --error"; break;
-                    case icon::warning: command += " --warning"; break;
-                    default: command += " --info"; break;
+                    case icon::error: command.push_back("--error"); break;
+                    case icon::warning: command.push_back("--warning"); break;
+                    default: command.push_back("--info"); break;
                 }
         }
 
-        command += " --title " + shell_quote(title)
-                 + " --width 300 --height 0" // sensible defaults
-                 + " --text " + shell_quote(text)
-                 + " --icon-name=dialog-" + get_icon_name(_icon);
+        command.insert(command.end(), { "--title", title,
+                                        "--width", "300", "--height", "0", // sensible defaults
+                                        "--text", "",
+                                        "--icon-name=dialog-" + get_icon_name(_icon) });
+        t.slot_arg = command.size() - 2;
     }
-    else if (is_kdialog())
+#endif
+#if PFD_HAS_BACKEND(KDIALOG)
+    if (is_kdialog())
     {
         if (_choice == choice::ok)
         {
             switch (_icon)
             {
-                case icon::error: command += " --error"; break;
-                case icon::warning: command += " --sorry"; break;
-                default: command += " --msgbox"; break;
+                case icon::error: command.push_back("--error"); break;
+                case icon::warning: command.push_back("--sorry"); break;
+                default: command.push_back("--msgbox"); break;
             }
         }
         else
         {
-            command += " --";
+            std::string mode = "--";
             if (_icon == icon::warning || _icon == icon::error)
-                command += "warning";
-            command += "yesno";
+                mode += "warning";
+            mode += "yesno";
             if (_choice == choice::yes_no_cancel)
-                command += "cancel";
+                mode += "cancel";
+            command.push_back(mode);
             if (_choice == choice::yes_no || _choice == choice::yes_no_cancel)
             {
-                m_mappings[0] = button::yes;
-                m_mappings[256] = button::no;
+                mappings[0] = button::yes;
+                mappings[256] = button::no;
             }
         }
 
-        command += " " + shell_quote(text)
-                 + " --title " + shell_quote(title);
+        t.slot_arg = command.size();
+        command.insert(command.end(), { "", "--title", title });
 
         // Must be after the above part
         if (_choice == choice::ok_cancel)
-            command += " --yes-label OK --no-label Cancel";
+            command.insert(command.end(), { "--yes-label", "OK", "--no-label", "Cancel" });
     }
-
-    if (flags(flag::is_verbose))
-        std::cerr << "pfd: " << command << std::endl;
-
-    m_async->start(command);
 #endif
+
+    return t;
 }
+#endif
 
-inline button message::result()
+PFD_INLINE button message::result()
 {
     int exit_code;
     auto ret = m_async->result(&exit_code);
+    return decode(ret, exit_code, m_mappings);
+}
+
+PFD_INLINE message &message::then(std::function<void(button)> const &callback,
+                              callback_queue *queue /* = nullptr */)
+{
+    auto mappings = m_mappings;
+    dialog::then([callback, mappings](std::string const &out, int exit_code)
+    {
+        callback(decode(out, exit_code, mappings));
+    }, queue);
+    return *this;
+}
+
+PFD_INLINE message &message::timeout(int ms, button default_button /* = button::cancel */)
+{
+    auto out = encode(default_button);
+    expire_after(ms, out, out.empty() ? -1 : 0);
+    return *this;
+}
+
+PFD_INLINE std::string message::encode(button b)
+{
+    switch (b)
+    {
+        case button::ok: return "OK\n";
+        case button::yes: return "Yes\n";
+        case button::no: return "No\n";
+        case button::abort: return "Abort\n";
+        case button::retry: return "Retry\n";
+        case button::ignore: return "Ignore\n";
+        /* case button::cancel: */ default: return "";
+    }
+}
+
+PFD_INLINE button message::decode(std::string const &ret, int exit_code,
+                              internal::int_map<button> const &mappings)
+{
     // osascript will say "button returned:Cancel\n"
     // and others will just say "Cancel\n"
     if (exit_code < 0 || // this means cancel
@@ -1463,22 +5368,29 @@ inline button message::result()
         return button::retry;
     if (internal::ends_with(ret, "Ignore\n"))
         return button::ignore;
-    if (m_mappings.count(exit_code) != 0)
-        return m_mappings[exit_code];
+    auto it = mappings.find(exit_code);
+    if (it != mappings.end())
+        return it->second;
     return exit_code == 0 ? button::ok : button::cancel;
 }
 
 // open_file implementation
 
-inline open_file::open_file(std::string const &title,
+PFD_INLINE open_file::open_file(std::string const &title,
                             std::string const &default_path /* = "" */,
-                            std::vector<std::string> filters /* = { "All Files", "*" } */,
+                            std::vector<std::string> filters /* = internal::default_filters() */,
                             opt options /* = opt::none */)
   : file_dialog(type::open, title, default_path, filters, options)
 {
 }
 
-inline open_file::open_file(std::string const &title,
+PFD_INLINE open_file::open_file(file_dialog_spec const &spec,
+                            std::string const &default_path /* = "" */)
+  : file_dialog(type::open, spec, default_path)
+{
+}
+
+PFD_INLINE open_file::open_file(std::string const &title,
                             std::string const &default_path,
                             std::vector<std::string> filters,
                             bool allow_multiselect)
@@ -1487,22 +5399,48 @@ inline open_file::open_file(std::string const &title,
 {
 }
 
-inline std::vector<std::string> open_file::result()
+PFD_INLINE std::vector<std::string> open_file::result()
 {
     return vector_result();
 }
 
+PFD_INLINE open_file &open_file::then(std::function<void(std::vector<std::string>)> const &callback,
+                                  callback_queue *queue /* = nullptr */)
+{
+    dialog::then([callback](std::string const &out, int)
+    {
+        callback(decode_vector(out));
+    }, queue);
+    return *this;
+}
+
+PFD_INLINE open_file &open_file::timeout(int ms,
+                                     std::vector<std::string> const &default_result /* = {} */)
+{
+    std::string out;
+    for (auto const &path : default_result)
+        out += path + '\n';
+    expire_after(ms, out, 0);
+    return *this;
+}
+
 // save_file implementation
 
-inline save_file::save_file(std::string const &title,
+PFD_INLINE save_file::save_file(std::string const &title,
                             std::string const &default_path /* = "" */,
-                            std::vector<std::string> filters /* = { "All Files", "*" } */,
+                            std::vector<std::string> filters /* = internal::default_filters() */,
                             opt options /* = opt::none */)
   : file_dialog(type::save, title, default_path, filters, options)
 {
 }
 
-inline save_file::save_file(std::string const &title,
+PFD_INLINE save_file::save_file(file_dialog_spec const &spec,
+                            std::string const &default_path /* = "" */)
+  : file_dialog(type::save, spec, default_path)
+{
+}
+
+PFD_INLINE save_file::save_file(std::string const &title,
                             std::string const &default_path,
                             std::vector<std::string> filters,
                             bool confirm_overwrite)
@@ -1511,25 +5449,65 @@ inline save_file::save_file(std::string const &title,
 {
 }
 
-inline std::string save_file::result()
+PFD_INLINE std::string save_file::result()
 {
     return string_result();
 }
 
+PFD_INLINE save_file &save_file::then(std::function<void(std::string)> const &callback,
+                                  callback_queue *queue /* = nullptr */)
+{
+    dialog::then([callback](std::string const &out, int)
+    {
+        callback(decode_string(out));
+    }, queue);
+    return *this;
+}
+
+PFD_INLINE save_file &save_file::timeout(int ms, std::string const &default_result /* = "" */)
+{
+    expire_after(ms, default_result, 0);
+    return *this;
+}
+
 // select_folder implementation
 
-inline select_folder::select_folder(std::string const &title,
+PFD_INLINE select_folder::select_folder(std::string const &title,
                                     std::string const &default_path /* = "" */,
                                     opt options /* = opt::none */)
   : file_dialog(type::folder, title, default_path, {}, options)
 {
 }
 
-inline std::string select_folder::result()
+PFD_INLINE select_folder::select_folder(file_dialog_spec const &spec,
+                                    std::string const &default_path /* = "" */)
+  : file_dialog(type::folder, spec, default_path)
+{
+}
+
+PFD_INLINE std::string select_folder::result()
 {
     return string_result();
 }
 
+PFD_INLINE select_folder &select_folder::then(std::function<void(std::string)> const &callback,
+                                          callback_queue *queue /* = nullptr */)
+{
+    dialog::then([callback](std::string const &out, int)
+    {
+        callback(decode_string(out));
+    }, queue);
+    return *this;
+}
+
+PFD_INLINE select_folder &select_folder::timeout(int ms, std::string const &default_result /* = "" */)
+{
+    expire_after(ms, default_result, 0);
+    return *this;
+}
+
+#undef PFD_INLINE
+
 #endif // PFD_SKIP_IMPLEMENTATION
 
 } // namespace pfd